@@ -19,6 +19,14 @@
 #include<queue>
 #include<algorithm>
 #include<cassert>
+#include<cstring>
+#include<stdint.h>
+#include<sstream>
+#include<thread>
+#include<atomic>
+#include<mutex>
+#include<memory>
+#include<sys/resource.h>
 
 using namespace std;
 
@@ -202,65 +210,130 @@ double singleEntropyTerm(unsigned long long count, unsigned long long total) {
 }
 
 /*
-    Computes all the necessary metrics by traversing the trace using a 
-    sliding window of size equal to the history pattern size (window size).
+    Flat hash table (open addressing, linear probing) counting the
+    occurrences of the history patterns of one length. A zero count marks
+    an empty slot. No slots are allocated before the first pattern.
 */
-void computePredictionRate(const vector<char>& branchResults, 
+class PatternTable {
+public:
+    PatternTable() : nPatterns(0) {}
+
+    void increment(unsigned long long key) {
+        if (entries.empty()) entries.resize(16);
+        size_t i = slot(key);
+        if (entries[i].count == 0) {
+            if ((nPatterns+1)*2 > entries.size()) {
+                grow();
+                i = slot(key);
+            }
+            entries[i].key = key;
+            ++nPatterns;
+        }
+        ++entries[i].count;
+    }
+
+    unsigned long long get(unsigned long long key) const {
+        if (entries.empty()) return 0;
+        return entries[slot(key)].count;
+    }
+
+    unsigned long long size() const { return nPatterns; }
+
+    /* The (pattern, count) pairs in increasing pattern order */
+    vector<pair<unsigned long long,unsigned long long> > sorted() const {
+        vector<pair<unsigned long long,unsigned long long> > patterns;
+        patterns.reserve(nPatterns);
+        for (auto& e : entries)
+            if (e.count) patterns.push_back(make_pair(e.key, e.count));
+        sort(patterns.begin(), patterns.end());
+        return patterns;
+    }
+
+    void clear() {
+        vector<Entry>().swap(entries);
+        nPatterns = 0;
+    }
+
+private:
+    struct Entry {
+        unsigned long long key;
+        unsigned long long count;
+        Entry() : key(0), count(0) {}
+    };
+    vector<Entry> entries;
+    unsigned long long nPatterns;
+
+    size_t slot(unsigned long long key) const {
+        size_t mask = entries.size()-1;
+        size_t i = (key * 0x9E3779B97F4A7C15ULL) >> 32 & mask;
+        while (entries[i].count && entries[i].key != key) i = (i+1) & mask;
+        return i;
+    }
+
+    void grow() {
+        vector<Entry> old(entries.size()*2);
+        old.swap(entries);
+        for (auto& e : old) {
+            if (e.count) entries[slot(e.key)] = e;
+        }
+    }
+};
+
+/*
+    The patterns of every window size (history pattern size + 1) of one
+    stream of outcomes: one branch, or all of them for the global analysis.
+    The outcomes are counted as the trace is read and are not kept.
+*/
+class PatternCounter {
+public:
+    PatternCounter(unsigned int historyBufferSizeMax)
+    : patterns(historyBufferSizeMax+2), key(0), nEvents(0) {}
+
+    void add(char outcome) {
+        key = (key << 1) + outcome;
+        ++nEvents;
+        unsigned long long maxWindowSize = min((unsigned long long)patterns.size()-1, nEvents);
+        for(unsigned int windowSize = 1; windowSize <= maxWindowSize; windowSize++) {
+            unsigned long long mask = (windowSize >= 64 ? ~0ULL : (((unsigned long long)1) << windowSize)-1);
+            patterns[windowSize].increment(key & mask);
+        }
+    }
+
+    // patterns[windowSize] counts the windows of the trace: the key holds the
+    // outcomes of the window, the oldest in the most significant bit
+    vector<PatternTable> patterns;
+    unsigned long long key;
+    unsigned long long nEvents;
+};
+
+/*
+    Computes all the necessary metrics from the patterns counted by counter,
+    whose tables are released. nTableEntries must be sorted. The DEBUG lines
+    go to debug.
+*/
+void computePredictionRate(PatternCounter& counter, 
                            vector<WindowInfo>& result, 
                            const unsigned int historyBufferSizeMax, 
-                           vector<unsigned long long>& nTableEntries, 
-                           map<double,double> table) {
+                           const vector<unsigned long long>& nTableEntries, 
+                           ostream& debug) {
                                
-    unsigned long long nEvents = branchResults.size();
+    unsigned long long nEvents = counter.nEvents;
     double old_entropy = 0;
-    map<unsigned long long,unsigned long long> twoBranchPatterns[2];
 
     result.resize(historyBufferSizeMax);
 
-    sort(nTableEntries.begin(), nTableEntries.end());
     const unsigned long long maxSize = nTableEntries.back();
     
-    bool useSlidingWindow = true;
-    bool optimizeKeyComputation = true;
+    vector<PatternTable>& patterns = counter.patterns;
+
+    vector<pair<unsigned long long,unsigned long long> > branchPatterns, prevBranchPatterns;
     
     for(unsigned int windowSize = 1; windowSize <= historyBufferSizeMax+1; windowSize++) {
-        if (windowSize > 1) cerr << "\tProcessing for window size " << (windowSize-1) << " ";
-        map<unsigned long long,unsigned long long>& branchPatterns = twoBranchPatterns[windowSize%2];
-        map<unsigned long long,unsigned long long>& prevBranchPatterns = twoBranchPatterns[1-(windowSize%2)];
-        
-        unsigned long long count = 0;
-        unsigned int increment = (useSlidingWindow?1:windowSize);
-        branchPatterns.clear();
-
-        unsigned long long key = 0;
-        unsigned long long mask = ~(((unsigned long long)1) << (windowSize-1));
-        int nPointsShown = 0;
-        int nPointsTotal = 20;
+        prevBranchPatterns.swap(branchPatterns);
+        branchPatterns = patterns[windowSize].sorted();
+        if (windowSize > 1) patterns[windowSize-2].clear();
         
-        for(unsigned long long windowStart = 0; windowStart < nEvents-windowSize+1; windowStart +=increment) {
-            if (windowSize > 1) {
-                while ((windowStart+1)*nPointsTotal/(nEvents-windowSize+1) > nPointsShown) {
-                    cerr << ".";
-                    ++nPointsShown;
-                    if (nPointsShown == nPointsTotal) cerr << " DONE " << endl;
-                }
-            }
-            if (windowStart == 0 || !optimizeKeyComputation || !useSlidingWindow) {
-                key = 0;
-                for(unsigned int withinWindowIndex = 0; withinWindowIndex < windowSize; withinWindowIndex++) {
-                    key += ((unsigned long long)(branchResults[windowStart+withinWindowIndex]-'0')) << (windowSize-withinWindowIndex-1);
-                }
-            } else {
-                // unsigned long long oldKey = key;
-                key = ((key & mask) << 1) + (branchResults[windowStart+windowSize-1]-'0');
-                // if (windowSize == 1) {
-                //    cout << "DEBUG: windowSize=" << windowSize << " mask=" << mask << " oldKey=" << oldKey 
-                //         << " outcome=" << branchResults[windowStart+windowSize-1] << " newKey=" << key << endl;
-                // }
-            }
-            ++branchPatterns[key];
-            ++count;
-        }
+        unsigned long long count = nEvents-windowSize+1;
         
         if (windowSize <= historyBufferSizeMax) {
             double entropy = 0;
@@ -309,9 +382,9 @@ void computePredictionRate(const vector<char>& branchResults,
                 if (windowSize > 1) {
                     diff -= result[windowSize-2].limitedEntropies[result[windowSize-1].limitedEntropies.size()-1];
                 }
-                cout << "DEBUG: i=" << i << " window=" << windowSize << " newEntropy=" << newEntropy << " diff=" << diff << "\n";
+                debug << "DEBUG: i=" << i << " window=" << windowSize << " newEntropy=" << newEntropy << " diff=" << diff << "\n";
             }
-            cout << "DEBUG: window=" << windowSize << " entropy=" << entropy << " diff=" << (entropy - old_entropy) << "\n";
+            debug << "DEBUG: window=" << windowSize << " entropy=" << entropy << " diff=" << (entropy - old_entropy) << "\n";
         
             /*  END: new form of entropy calculation that takes 
                 into acount the limited pattern table size 
@@ -338,10 +411,8 @@ void computePredictionRate(const vector<char>& branchResults,
             for (auto kv:prevBranchPatterns) {
                 unsigned long long key0 = kv.first << 1;
                 unsigned long long key1 = key0 + 1;
-                unsigned long long count0 = 0;
-                if (branchPatterns.find(key0) != branchPatterns.end()) count0=branchPatterns[key0];
-                unsigned long long count1 = 0;
-                if (branchPatterns.find(key1) != branchPatterns.end()) count1=branchPatterns[key1];
+                unsigned long long count0 = patterns[windowSize].get(key0);
+                unsigned long long count1 = patterns[windowSize].get(key1);
                 
                 HistoryPattern hp(count0, count1);
                 prc.registerPattern(count0, count1);
@@ -397,55 +468,465 @@ void computePredictionRate(const vector<char>& branchResults,
             result[windowSize-2].nBranchesMore = nBranchesMore;
         }
     }
+    vector<PatternTable>().swap(patterns);
+}
+
+unsigned int floorLog2(unsigned long long n) {
+    unsigned int bits = 0;
+    while ((1ULL << (bits+1)) <= n) ++bits;
+    return bits;
+}
+
+/*
+    Simulated branch predictors. They see the branches in trace order: pc
+    identifies the static branch and history holds the outcomes of the
+    previous branches, the most recent in the least significant bit. All the
+    tables are flat arrays indexed by hashes of pc and history.
+*/
+class Predictor {
+public:
+    Predictor(const string& name, unsigned long long nEntries, unsigned int historyLength)
+    : name(name), nEntries(nEntries), historyLength(historyLength), mispredictions(0) {}
+    virtual ~Predictor() {}
+
+    /* Predicts the branch, then trains with its outcome */
+    void add(uint64_t pc, uint64_t history, bool outcome) {
+        if (predictAndUpdate(pc, history, outcome) != outcome) ++mispredictions;
+    }
+
+    string name;
+    unsigned long long nEntries;
+    unsigned int historyLength;
+    unsigned long long mispredictions;
+
+protected:
+    /* Returns the prediction made before the update */
+    virtual bool predictAndUpdate(uint64_t pc, uint64_t history, bool outcome) = 0;
+
+    static uint64_t historyMask(unsigned int length) {
+        return length >= 64 ? ~0ULL : (1ULL << length) - 1;
+    }
+
+    /* Folds the history into bits bits */
+    static uint64_t fold(uint64_t history, unsigned int bits) {
+        uint64_t folded = 0;
+        for (; history; history >>= bits) folded ^= history;
+        return folded & historyMask(bits);
+    }
+};
+
+/* 2-bit saturating counters */
+static inline bool updateCounter(uint8_t& counter, bool outcome) {
+    bool prediction = counter >= 2;
+    if (outcome && counter < 3) ++counter;
+    if (!outcome && counter > 0) --counter;
+    return prediction;
+}
+
+/* One 2-bit counter per entry, indexed by pc */
+class BimodalPredictor : public Predictor {
+public:
+    BimodalPredictor(unsigned long long nEntries)
+    : Predictor("bimodal", nEntries, 0), counters(nEntries, 2) {}
+
+protected:
+    bool predictAndUpdate(uint64_t pc, uint64_t, bool outcome) {
+        return updateCounter(counters[pc & (nEntries-1)], outcome);
+    }
+
+    vector<uint8_t> counters;
+};
+
+/* One 2-bit counter per entry, indexed by pc xor history */
+class GsharePredictor : public Predictor {
+public:
+    GsharePredictor(unsigned long long nEntries, unsigned int historyLength)
+    : Predictor("gshare", nEntries, historyLength), counters(nEntries, 2) {}
+
+protected:
+    bool predictAndUpdate(uint64_t pc, uint64_t history, bool outcome) {
+        uint64_t h = fold(history & historyMask(historyLength), floorLog2(nEntries));
+        return updateCounter(counters[(pc ^ h) & (nEntries-1)], outcome);
+    }
+
+    vector<uint8_t> counters;
+};
+
+/*
+    Small TAGE: a bimodal base predictor and TAGE_TABLES tagged tables of
+    nEntries entries each, indexed with geometrically increasing history
+    lengths up to historyLength. The longest matching table provides the
+    prediction.
+*/
+#define TAGE_TABLES 4
+#define TAGE_TAG_BITS 9
+#define TAGE_RESET_PERIOD (1 << 18)
+
+class TagePredictor : public Predictor {
+public:
+    TagePredictor(unsigned long long nEntries, unsigned int historyLength)
+    : Predictor("tage", nEntries, historyLength), base(nEntries, 2),
+      entries(TAGE_TABLES*nEntries), nBranches(0) {
+        for (unsigned int t = 0; t < TAGE_TABLES; ++t)
+            lengths[t] = max(1u, (unsigned int)(historyLength*pow(2.0, (int)t-(TAGE_TABLES-1))));
+    }
+
+protected:
+    struct Entry {
+        uint16_t tag;
+        int8_t counter;
+        uint8_t useful;
+        Entry() : tag(0), counter(0), useful(0) {}
+    };
+
+    bool predictAndUpdate(uint64_t pc, uint64_t history, bool outcome) {
+        unsigned int indexBits = floorLog2(nEntries);
+        Entry* entry[TAGE_TABLES];
+        uint16_t tag[TAGE_TABLES];
+        int provider = -1, alternate = -1;
+
+        for (int t = 0; t < TAGE_TABLES; ++t) {
+            uint64_t h = history & historyMask(lengths[t]);
+            uint64_t index = (pc ^ (pc >> indexBits) ^ fold(h, indexBits)) & (nEntries-1);
+            tag[t] = (pc ^ fold(h, TAGE_TAG_BITS) ^ (fold(h, TAGE_TAG_BITS-1) << 1)) & historyMask(TAGE_TAG_BITS);
+            entry[t] = &entries[t*nEntries + index];
+            if (entry[t]->tag == tag[t]) {
+                alternate = provider;
+                provider = t;
+            }
+        }
+
+        uint8_t& baseCounter = base[pc & (nEntries-1)];
+        bool alternatePrediction = alternate >= 0 ? entry[alternate]->counter >= 0 : baseCounter >= 2;
+        bool prediction = provider >= 0 ? entry[provider]->counter >= 0 : baseCounter >= 2;
+
+        if (provider >= 0) {
+            Entry& e = *entry[provider];
+            if (outcome && e.counter < 3) ++e.counter;
+            if (!outcome && e.counter > -4) --e.counter;
+            if (prediction != alternatePrediction) {
+                if (prediction == outcome && e.useful < 3) ++e.useful;
+                if (prediction != outcome && e.useful > 0) --e.useful;
+            }
+        } else {
+            updateCounter(baseCounter, outcome);
+        }
+
+        // On a misprediction, allocate an entry in a table with a longer history
+        if (prediction != outcome) {
+            bool allocated = false;
+            for (int t = provider+1; t < TAGE_TABLES && !allocated; ++t) {
+                if (entry[t]->useful == 0) {
+                    entry[t]->tag = tag[t];
+                    entry[t]->counter = outcome ? 0 : -1;
+                    allocated = true;
+                }
+            }
+            for (int t = provider+1; t < TAGE_TABLES && !allocated; ++t)
+                --entry[t]->useful;
+        }
+
+        if (++nBranches % TAGE_RESET_PERIOD == 0)
+            for (auto& e : entries) e.useful >>= 1;
+
+        return prediction;
+    }
+
+    vector<uint8_t> base;
+    vector<Entry> entries;
+    unsigned int lengths[TAGE_TABLES];
+    unsigned long long nBranches;
+};
+
+/*
+    nEntries perceptrons indexed by pc, each with a bias and one weight per
+    history bit, trained when mispredicting or when the output is below the
+    threshold.
+*/
+class PerceptronPredictor : public Predictor {
+public:
+    PerceptronPredictor(unsigned long long nEntries, unsigned int historyLength)
+    : Predictor("perceptron", nEntries, historyLength),
+      weights(nEntries*(historyLength+1), 0), threshold((int)(1.93*historyLength + 14)) {}
+
+protected:
+    bool predictAndUpdate(uint64_t pc, uint64_t history, bool outcome) {
+        int8_t* w = &weights[(pc & (nEntries-1))*(historyLength+1)];
+        int y = w[0];
+        for (unsigned int i = 0; i < historyLength; ++i)
+            y += (history >> i & 1) ? w[i+1] : -w[i+1];
+
+        bool prediction = y >= 0;
+        if (prediction != outcome || abs(y) <= threshold) {
+            train(w[0], outcome);
+            for (unsigned int i = 0; i < historyLength; ++i)
+                train(w[i+1], outcome == (bool)(history >> i & 1));
+        }
+        return prediction;
+    }
+
+    static void train(int8_t& weight, bool increment) {
+        if (increment && weight < 127) ++weight;
+        if (!increment && weight > -127) --weight;
+    }
+
+    vector<int8_t> weights;
+    int threshold;
+};
+
+/*
+    The predictors simulated in the single pass over the trace. Change the
+    constructor when other configurations are necessary; the table sizes
+    must be powers of 2.
+*/
+class PredictorSuite {
+public:
+    PredictorSuite() : history(0), nBranches(0) {
+        for (unsigned long long nEntries : {1024ULL, 4096ULL, 16384ULL}) {
+            predictors.push_back(unique_ptr<Predictor>(new BimodalPredictor(nEntries)));
+            predictors.push_back(unique_ptr<Predictor>(new GsharePredictor(nEntries, floorLog2(nEntries))));
+        }
+        for (unsigned long long nEntries : {256ULL, 1024ULL, 4096ULL})
+            predictors.push_back(unique_ptr<Predictor>(new TagePredictor(nEntries, 64)));
+        for (unsigned long long nEntries : {256ULL, 1024ULL})
+            predictors.push_back(unique_ptr<Predictor>(new PerceptronPredictor(nEntries, 32)));
+    }
+
+    void add(const Branch& branch, bool outcome) {
+        uint64_t pc = branch.func_id*0x9E3779B97F4A7C15ULL ^ branch.bb_id*0xC2B2AE3D27D4EB4FULL ^ branch.instr_id*0x165667B19E3779F9ULL;
+        pc ^= pc >> 29;
+        for (auto& p : predictors)
+            p->add(pc, history, outcome);
+        history = (history << 1) | outcome;
+        ++nBranches;
+    }
+
+    void write(ostream& out) const {
+        out << "predictor,tableEntries,historyLength,mispredictions,mispredictionRate" << endl;
+        for (auto& p : predictors)
+            out << p->name << "," << p->nEntries << "," << p->historyLength << ","
+                << p->mispredictions << "," << (nBranches ? (double)p->mispredictions/nBranches : 0) << endl;
+    }
+
+private:
+    vector<unique_ptr<Predictor> > predictors;
+    uint64_t history;
+    unsigned long long nBranches;
+};
+
+/*
+    Counts the patterns of every branch (of all of them together for the
+    global analysis) while the trace is read. The events are buffered in
+    chunks. A chunk is grouped by branch, keeping the trace order within each
+    branch, and the branches are counted in parallel. The memory depends on
+    the number of branches and of history patterns, not on the length of the
+    trace. The predictors, if any, are simulated on the events as they are
+    read.
+*/
+#define TRACE_CHUNK_EVENTS (1 << 20)
+
+class TraceCounter {
+public:
+    TraceCounter(bool isGlobal, unsigned int historyBufferSizeMax, unsigned int nThreads, PredictorSuite* predictors)
+    : nEvents(0), isGlobal(isGlobal), historyBufferSizeMax(historyBufferSizeMax), nThreads(nThreads), predictors(predictors) {}
+
+    void add(Branch branch, char outcome) {
+        if (predictors) predictors->add(branch, outcome);
+        if (isGlobal) branch = Branch();
+        auto it = index.find(branch);
+        if (it == index.end()) {
+            it = index.insert(make_pair(branch, (unsigned int)counters.size())).first;
+            counters.push_back(PatternCounter(historyBufferSizeMax));
+        }
+        chunk.push_back(make_pair(it->second, outcome));
+        ++nEvents;
+        if (chunk.size() == TRACE_CHUNK_EVENTS) flush();
+    }
+
+    /* Counts the buffered events */
+    void flush() {
+        if (chunk.empty()) return;
+
+        vector<size_t> offsets(counters.size()+1, 0);
+        for (auto& event : chunk)
+            ++offsets[event.first+1];
+        for (size_t i = 1; i < offsets.size(); ++i)
+            offsets[i] += offsets[i-1];
+        vector<char> outcomes(chunk.size());
+        vector<size_t> next(offsets.begin(), offsets.end()-1);
+        for (auto& event : chunk)
+            outcomes[next[event.first]++] = event.second;
+
+        unsigned int nWorkers = min(nThreads, (unsigned int)counters.size());
+        atomic<size_t> nextBranch(0);
+        auto worker = [&]() {
+            for (size_t b = nextBranch++; b < counters.size(); b = nextBranch++)
+                for (size_t i = offsets[b]; i < offsets[b+1]; ++i)
+                    counters[b].add(outcomes[i]);
+        };
+        vector<thread> pool;
+        for (unsigned int t = 1; t < nWorkers; ++t)
+            pool.push_back(thread(worker));
+        worker();
+        for (auto& t : pool)
+            t.join();
+        chunk.clear();
+        cerr << "\tCounted " << nEvents << " branch events" << endl;
+    }
+
+    map<Branch, unsigned int> index;
+    vector<PatternCounter> counters;
+    unsigned long long nEvents;
+
+private:
+    bool isGlobal;
+    unsigned int historyBufferSizeMax;
+    unsigned int nThreads;
+    PredictorSuite* predictors;
+    vector<pair<unsigned int, char> > chunk;
+};
+
+/*
+    Reads a binary trace written with -branch-entropy-binary: a magic string
+    followed by one 32-bit record per branch, (id << 1) | outcome, where id
+    numbers the control instructions of the module. Returns false if the file
+    is not a binary trace.
+*/
+#define BINARY_TRACE_MAGIC "PISABRT1"
+#define BINARY_TRACE_MAGIC_SIZE 8
+#define BINARY_TRACE_CHUNK 65536
+
+bool readBinaryTrace(const char* filename, TraceCounter& trace) {
+    ifstream ifp(filename, ios::binary);
+    char magic[BINARY_TRACE_MAGIC_SIZE];
+
+    if (!ifp.read(magic, BINARY_TRACE_MAGIC_SIZE) || memcmp(magic, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_SIZE))
+        return false;
+
+    vector<uint32_t> records(BINARY_TRACE_CHUNK);
+    while (ifp) {
+        ifp.read((char*)records.data(), records.size()*sizeof(uint32_t));
+        unsigned long long nRecords = ifp.gcount()/sizeof(uint32_t);
+        for (unsigned long long i = 0; i < nRecords; ++i)
+            trace.add(Branch(0, 0, records[i] >> 1, 0), records[i] & 1);
+    }
+
+    return true;
+}
+
+/*
+    Parses one line of a text trace: a branch of the raw trace written by
+    -branch-entropy (7 fields) or of the output of filter.sh (4 fields).
+    Every other line (the header, the line count, the switch lines) is
+    skipped. The last field must be followed by a space, a newline or a NUL.
+*/
+void parseTraceLine(const char* begin, const char* end, TraceCounter& trace) {
+    const char* field[8];
+    size_t length[8];
+    unsigned int nFields = 0;
+
+    for (const char* p = begin; p < end && nFields < 8; ) {
+        while (p < end && isspace(*p)) ++p;
+        if (p == end) break;
+        field[nFields] = p;
+        while (p < end && !isspace(*p)) ++p;
+        length[nFields] = p - field[nFields];
+        ++nFields;
+    }
+
+    unsigned int first;
+    if (nFields == 7) first = 1;
+    else if (nFields == 4) first = 0;
+    else return;
+
+    const char* outcome = field[first+3];
+    if (length[first+3] != 1 || !(*outcome == '0' || *outcome == '1')) {
+        cerr << "ERROR: Found outcome=`" << string(outcome, length[first+3]) << "`. Was expecting 0/1." << endl;
+        exit(-1);
+    }
+
+    Branch tmp(strtoul(field[first], NULL, 10), strtoul(field[first+1], NULL, 10), strtoul(field[first+2], NULL, 10), 0);
+    trace.add(tmp, *outcome - '0');
+}
+
+/*
+    Reads a text trace in blocks of TEXT_TRACE_BLOCK bytes. Returns false if
+    the file can not be opened.
+*/
+#define TEXT_TRACE_BLOCK (1 << 20)
+
+bool readTextTrace(const char* filename, TraceCounter& trace) {
+    ifstream ifp(filename, ios::binary);
+    if (!ifp.is_open()) return false;
+
+    vector<char> block(TEXT_TRACE_BLOCK);
+    string partial;
+    while (ifp) {
+        ifp.read(block.data(), block.size());
+        const char* p = block.data();
+        const char* end = p + ifp.gcount();
+        for (const char* eol; (eol = (const char*)memchr(p, '\n', end - p)); p = eol + 1) {
+            if (partial.empty()) {
+                parseTraceLine(p, eol, trace);
+            } else {
+                partial.append(p, eol);
+                parseTraceLine(partial.data(), partial.data() + partial.size(), trace);
+                partial.clear();
+            }
+        }
+        partial.append(p, end);
+    }
+    parseTraceLine(partial.data(), partial.data() + partial.size(), trace);
+
+    return true;
 }
 
 int main(int argc, char*argv[]) {
-    unsigned long long nEvents          = 0;
     unsigned int historyBufferSizeMax   = 0;
 
-    ifstream ifp;
-
     if (argc < 4) {
-        cerr << "Program usage: ./entropy <input file> <history buffer length> <global/local 0/1>\n";
+        cerr << "Program usage: ./entropy <input file> <history buffer length> <global/local 0/1> [threads] [predictors output file]\n";
         return -1;
     }
     
     bool isGlobal = true;
     if (atoi(argv[3]) == 1) isGlobal = false;
     historyBufferSizeMax = atoi(argv[2]);
-    ifp.open(argv[1]);
 
-    if (!ifp.is_open()) {
-        cerr << "Can't open input file\n";
-        return -1;
-    }
+    /* Branches counted and analysed in parallel (local analysis); default: all the cores */
+    unsigned int nThreads = thread::hardware_concurrency();
+    if (argc > 4) nThreads = atoi(argv[4]);
+    if (nThreads == 0) nThreads = 1;
     
     /* Change this vector when different table sizes are necessary for analysis */
     vector<unsigned long long> nTableEntries = {8,32,64,256,512,1024,2*1024,4*1024,8*1024,16*1024,32*1024};
 
-    ifp >> nEvents;
-    cerr << "Number of conditional branch events is " << nEvents << "\n";
-
     map<unsigned long long, unsigned long long> branchPatterns;
-    vector<char> branchResults(nEvents);
-    map<Branch, vector<char> > branches;
+
+    /* Simulated predictors, written to a separate CSV file when one is given */
+    unique_ptr<PredictorSuite> predictors;
+    if (argc > 5) predictors.reset(new PredictorSuite());
+
+    TraceCounter trace(isGlobal, historyBufferSizeMax, nThreads, predictors.get());
 
     cerr << "Start reading input file..." << "\n";
-    for(unsigned long long i = 0; i < nEvents; ++i) {
-        Branch tmp;
-        char outcome;
-        ifp >> tmp.func_id >> tmp.bb_id >> tmp.instr_id >> outcome;
-        if (!(outcome == '0' || outcome == '1')) {
-            cerr << "ERROR: Found outcome=`" << outcome << "`. Was expecting 0/1." << endl;
-            exit(-1);
-        }
-        if (isGlobal) {tmp.func_id = tmp.bb_id = tmp.instr_id = 0;}
-        branches[tmp].push_back(outcome);
+    if (!readBinaryTrace(argv[1], trace) && !readTextTrace(argv[1], trace)) {
+        cerr << "Can't open input file\n";
+        return -1;
     }
-
-    ifp.close();
+    trace.flush();
     cerr << "Reading DONE" << "\n";
-    cerr << "Detected a total of " << branches.size() << " branches" << endl;
+    cerr << "Number of branch events is " << trace.nEvents << "\n";
+    cerr << "Detected a total of " << trace.index.size() << " branches" << endl;
+
+    if (predictors) {
+        ofstream out(argv[5]);
+        if (!out.is_open()) {
+            cerr << "Can't open predictors output file\n";
+            return -1;
+        }
+        predictors->write(out);
+    }
 
     map<Branch, vector<WindowInfo> > result;
 
@@ -457,15 +938,52 @@ int main(int argc, char*argv[]) {
     map<double,double> table;
     buildInverseEntropyTable(table);
     
-    int counter = 0;
-    for(auto it = branches.begin(); it != branches.end(); ++it) {
-        cerr << "Starting processing for branch " << (++counter) << "/" << branches.size() << endl;
-        // cout << "Branch " << it->first << " " << it->second.size() << "\n";
-        if (it->second.size() > historyBufferSizeMax) {
-            computePredictionRate(it->second, result[it->first], historyBufferSizeMax, nTableEntries, table);
+    sort(nTableEntries.begin(), nTableEntries.end());
+
+    /*
+        The branches are processed in parallel, each by one thread into its
+        own result. The DEBUG output of each branch is buffered and written
+        in branch order, as a sequential run does.
+    */
+    vector<pair<PatternCounter*, vector<WindowInfo>*> > work;
+    for(auto it = trace.index.begin(); it != trace.index.end(); ++it) {
+        PatternCounter& counter = trace.counters[it->second];
+        if (counter.nEvents > historyBufferSizeMax) {
+            work.push_back(make_pair(&counter, &result[it->first]));
         }
     }
 
+    nThreads = min(nThreads, (unsigned int)work.size());
+    vector<string> debugOutput(work.size());
+    vector<bool> debugReady(work.size(), false);
+    size_t nextDebugOutput = 0;
+    unsigned long long counter = 0;
+    atomic<size_t> nextBranch(0);
+    mutex outputLock;
+
+    auto worker = [&]() {
+        for (size_t k = nextBranch++; k < work.size(); k = nextBranch++) {
+            ostringstream debug;
+            computePredictionRate(*work[k].first, *work[k].second, historyBufferSizeMax, nTableEntries, debug);
+
+            lock_guard<mutex> guard(outputLock);
+            cerr << "Finished processing for branch " << (++counter) << "/" << work.size() << endl;
+            debugOutput[k] = debug.str();
+            debugReady[k] = true;
+            for (; nextDebugOutput < work.size() && debugReady[nextDebugOutput]; ++nextDebugOutput) {
+                cout << debugOutput[nextDebugOutput];
+                string().swap(debugOutput[nextDebugOutput]);
+            }
+        }
+    };
+
+    vector<thread> pool;
+    for (unsigned int i = 1; i < nThreads; ++i)
+        pool.push_back(thread(worker));
+    worker();
+    for (auto& t : pool)
+        t.join();
+
 /*
     for(auto it = result.begin(); it != result.end(); ++it) {
         for(unsigned int win = 0; win < historyBufferSizeMax - 1; ++win) 
@@ -499,34 +1017,35 @@ int main(int argc, char*argv[]) {
         vector<LimitedPredictionRate> limitedPredictionRates;
         
         for(auto it = result.begin(); it != result.end(); ++it) {
-            sumEntropy = sumEntropy + it->second[win].entropy*branches[it->first].size();
-            sumDifference = sumDifference + it->second[win].difference*branches[it->first].size();
-            sumInverse = sumInverse + inverseEntropy(table,it->second[win].difference)*branches[it->first].size();
-            sumPredictionRate[BASIC] += it->second[win].predictionRate_BASIC*branches[it->first].size();
-            sumPredictionRate[SEEN_ONCE_05] += it->second[win].predictionRate_SEEN_ONCE_05*branches[it->first].size();
-            sumPredictionRate[SEEN_FIRST_05] += it->second[win].predictionRate_SEEN_FIRST_05*branches[it->first].size();
-            sumPredictionRate[SEEN_ONCE_DISCARDED] += it->second[win].predictionRate_SEEN_ONCE_DISCARDED*branches[it->first].size();
-            sumPredictionRate[SEEN_FIRST_DISCARDED] += it->second[win].predictionRate_SEEN_FIRST_DISCARDED*branches[it->first].size();
-            sumPatterns += it->second[win].nHistoryPatterns*branches[it->first].size();
-            sumBranches0 += it->second[win].nBranches0*branches[it->first].size();
-            sumBranches1 += it->second[win].nBranches1*branches[it->first].size();
-            sumBranchesMore += it->second[win].nBranchesMore*branches[it->first].size();
+            unsigned long long weight = trace.counters[trace.index[it->first]].nEvents;
+            sumEntropy = sumEntropy + it->second[win].entropy*weight;
+            sumDifference = sumDifference + it->second[win].difference*weight;
+            sumInverse = sumInverse + inverseEntropy(table,it->second[win].difference)*weight;
+            sumPredictionRate[BASIC] += it->second[win].predictionRate_BASIC*weight;
+            sumPredictionRate[SEEN_ONCE_05] += it->second[win].predictionRate_SEEN_ONCE_05*weight;
+            sumPredictionRate[SEEN_FIRST_05] += it->second[win].predictionRate_SEEN_FIRST_05*weight;
+            sumPredictionRate[SEEN_ONCE_DISCARDED] += it->second[win].predictionRate_SEEN_ONCE_DISCARDED*weight;
+            sumPredictionRate[SEEN_FIRST_DISCARDED] += it->second[win].predictionRate_SEEN_FIRST_DISCARDED*weight;
+            sumPatterns += it->second[win].nHistoryPatterns*weight;
+            sumBranches0 += it->second[win].nBranches0*weight;
+            sumBranches1 += it->second[win].nBranches1*weight;
+            sumBranchesMore += it->second[win].nBranchesMore*weight;
             
             if (limitedPredictionRates.empty()) {
                 for (unsigned int i=0;i<it->second[win].limitedPredictionRates.size();++i) {
                     limitedPredictionRates.push_back(LimitedPredictionRate(it->second[win].limitedPredictionRates[i].nEntries,
-                        it->second[win].limitedPredictionRates[i].predictionRate * branches[it->first].size(),
-                        it->second[win].limitedPredictionRates[i].fractionStored * branches[it->first].size()
+                        it->second[win].limitedPredictionRates[i].predictionRate * weight,
+                        it->second[win].limitedPredictionRates[i].fractionStored * weight
                     ));
                 }
             } else {
                 for (unsigned int i=0;i<limitedPredictionRates.size();++i) {
                     assert(limitedPredictionRates[i].nEntries == it->second[win].limitedPredictionRates[i].nEntries);
-                    limitedPredictionRates[i].predictionRate += it->second[win].limitedPredictionRates[i].predictionRate*branches[it->first].size();
-                    limitedPredictionRates[i].fractionStored += it->second[win].limitedPredictionRates[i].fractionStored*branches[it->first].size();
+                    limitedPredictionRates[i].predictionRate += it->second[win].limitedPredictionRates[i].predictionRate*weight;
+                    limitedPredictionRates[i].fractionStored += it->second[win].limitedPredictionRates[i].fractionStored*weight;
                 }
             }
-            total += branches[it->first].size();
+            total += weight;
         }
 
         cout << win + 1 << "," << sumEntropy/total << "," << sumDifference/total
@@ -552,5 +1071,9 @@ int main(int argc, char*argv[]) {
     // for (unsigned int index = 0; index < result.size(); ++index)
     //    cout << result[index].windowSize << "," << result[index].entropy << "," << result[index].difference << "\n";
 
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cerr << "Peak resident memory: " << usage.ru_maxrss << " kB" << endl;
+
     return 0;
 }
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Throughput and peak memory of branchBehavior on the synthetic corpus, per
+# history length, for the text and the binary traces.
+# Usage: ./benchmark.sh [events] [history lengths...]
+
+source branchTestDef.sh
+
+if [ $# -gt 0 ]; then events=$1; shift; fi
+lengths=(${@:-8 16 32})
+
+tmp=$(mktemp -d)
+build_tools $tmp
+
+echo "trace,format,analysis,historyLength,seconds,eventsPerSecond,peakMemoryKB"
+for trace in ${traces[*]}
+do
+    $tmp/traceGenerator $trace $events $seed > $tmp/$trace.txt
+    $tmp/traceGenerator -binary $trace $events $seed > $tmp/$trace.btrace
+
+    for format in txt btrace
+    do
+        for mode in 0 1
+        do
+            analysis=$([ $mode -eq 0 ] && echo global || echo local)
+            for length in ${lengths[*]}
+            do
+                start=$(date +%s%N)
+                $tmp/branchBehavior $tmp/$trace.$format $length $mode > /dev/null 2> $tmp/log
+                end=$(date +%s%N)
+                memory=$(grep "Peak resident memory" $tmp/log | awk '{print $4}')
+                awk -v t=$trace -v f=$format -v a=$analysis -v l=$length -v n=$events -v s=$start -v e=$end -v m=$memory \
+                    'BEGIN {seconds = (e - s) / 1e9; printf "%s,%s,%s,%d,%.3f,%.0f,%s\n", t, f, a, l, seconds, n / seconds, m}'
+            done
+        done
+    done
+    rm -f $tmp/$trace.txt $tmp/$trace.btrace
+done
+
+rm -rf $tmp
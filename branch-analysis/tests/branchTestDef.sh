@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Synthetic corpus of the branch analysis tests (see traceGenerator.cc)
+traces=(loop random correlated mix)
+events=200000
+seed=1
+history=12
+threads=2
+
+# Builds branchBehavior and traceGenerator into $1
+build_tools() {
+    g++ -O3 ../branchBehavior.cc --std=c++11 -pthread -o $1/branchBehavior || exit 1
+    g++ -O3 ../traceGenerator.cc --std=c++11 -o $1/traceGenerator || exit 1
+}
+
+# Writes the global, local and predictor outputs of trace $2 into $3 (tools in $1)
+analyse_trace() {
+    $1/traceGenerator $2 $events $seed > $3/$2.trace
+    $1/branchBehavior $3/$2.trace $history 0 $threads $3/$2.predictors.csv 2> /dev/null | grep -v "^DEBUG" > $3/$2.global.csv
+    $1/branchBehavior $3/$2.trace $history 1 $threads 2> /dev/null | grep -v "^DEBUG" > $3/$2.local.csv
+    rm -f $3/$2.trace
+}
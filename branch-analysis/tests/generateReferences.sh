@@ -0,0 +1,14 @@
+#!/bin/bash
+
+source branchTestDef.sh
+
+tmp=$(mktemp -d)
+build_tools $tmp
+
+for trace in ${traces[*]}
+do
+    echo Generating reference for $trace
+    analyse_trace $tmp $trace references
+done
+
+rm -rf $tmp
@@ -0,0 +1,29 @@
+#!/bin/bash
+
+source branchTestDef.sh
+
+tmp=$(mktemp -d)
+build_tools $tmp
+status=0
+
+for trace in ${traces[*]}
+do
+    echo "TESTING $trace"
+    analyse_trace $tmp $trace $tmp
+
+    for output in global local predictors
+    do
+        diff $tmp/$trace.$output.csv references/$trace.$output.csv > $tmp/differences.csv
+        if [ -s $tmp/differences.csv ]
+        then
+            echo "POSSIBLE PROBLEMS IN THE $output OUTPUT OF $trace:"
+            cat $tmp/differences.csv
+            status=1
+        else
+            echo "The $output output of $trace is FINE"
+        fi
+    done
+done
+
+rm -rf $tmp
+exit $status
@@ -0,0 +1,178 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/
+
+/*
+    Synthetic branch traces with a known behavior, for testing and
+    benchmarking branchBehavior. The same arguments always give the same
+    trace.
+
+    loop        every branch is a loop back-edge, taken (trip count - 1)
+                times and then not taken; the loops run one after the other
+    random      every branch is taken with its own probability
+    correlated  every branch repeats the outcome of the branch executed
+                1 to 8 events earlier, with 1% noise: predictable from the
+                global history but not from the local one
+    mix         the three above, by branch
+
+    The output is the raw text trace written by -branch-entropy, or the
+    binary trace written by -branch-entropy-binary.
+*/
+
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<stdint.h>
+#include<iostream>
+#include<string>
+#include<vector>
+
+using namespace std;
+
+#define LOOP_BRANCH         0
+#define RANDOM_BRANCH       1
+#define CORRELATED_BRANCH   2
+
+#define BINARY_TRACE_MAGIC "PISABRT1"
+#define BINARY_TRACE_MAGIC_SIZE 8
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+/* xorshift64*: the same sequence on every platform */
+class Random {
+public:
+    Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+
+    /* Uniform in [0, 1) */
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    unsigned int below(unsigned int n) {
+        return next() % n;
+    }
+
+private:
+    uint64_t state;
+};
+
+class TraceWriter {
+public:
+    TraceWriter(FILE* out, bool binary) : out(out), binary(binary) {
+        if (binary)
+            buffer.append(BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_SIZE);
+        else
+            buffer += "| Branch type | Function_ID | BasicBlock_ID | Instruction_ID | T/F | Thread_ID | Processor_ID|\n";
+    }
+
+    ~TraceWriter() {
+        flush();
+    }
+
+    /* Branch b is numbered as instruction 0 of basic block b%16 of function b/16 */
+    void add(unsigned int b, bool outcome) {
+        if (binary) {
+            uint32_t record = (b << 1) | outcome;
+            buffer.append((const char*)&record, sizeof(record));
+        } else {
+            buffer += "cb " + to_string(b / 16) + " " + to_string(b % 16) + " 0 " + (outcome ? "1" : "0") + " 0 0\n";
+        }
+        if (buffer.size() >= OUTPUT_BUFFER_SIZE) flush();
+    }
+
+private:
+    void flush() {
+        fwrite(buffer.data(), 1, buffer.size(), out);
+        buffer.clear();
+    }
+
+    FILE* out;
+    bool binary;
+    string buffer;
+};
+
+int main(int argc, char* argv[]) {
+    bool binary = false;
+    int arg = 1;
+
+    if (arg < argc && !strcmp(argv[arg], "-binary")) {
+        binary = true;
+        ++arg;
+    }
+
+    if (argc - arg < 3) {
+        cerr << "Program usage: ./traceGenerator [-binary] <loop/random/correlated/mix> <number of events> <seed> [branches]\n";
+        return -1;
+    }
+
+    string kind = argv[arg];
+    unsigned long long nEvents = strtoull(argv[arg+1], NULL, 10);
+    Random random(strtoull(argv[arg+2], NULL, 10));
+    unsigned int nBranches = argc - arg > 3 ? atoi(argv[arg+3]) : 64;
+
+    int branchKind;
+    if (kind == "loop") branchKind = LOOP_BRANCH;
+    else if (kind == "random") branchKind = RANDOM_BRANCH;
+    else if (kind == "correlated") branchKind = CORRELATED_BRANCH;
+    else if (kind == "mix") branchKind = -1;
+    else {
+        cerr << "Unknown trace kind `" << kind << "`\n";
+        return -1;
+    }
+    if (nBranches == 0) nBranches = 1;
+
+    /* Trip count, probability of being taken and correlation distance per branch */
+    vector<int> kinds(nBranches);
+    vector<unsigned int> tripCount(nBranches);
+    vector<double> probability(nBranches);
+    vector<unsigned int> distance(nBranches);
+    for (unsigned int b = 0; b < nBranches; ++b) {
+        kinds[b] = branchKind >= 0 ? branchKind : b % 3;
+        tripCount[b] = 2 + b % 15;
+        probability[b] = (b + 1.0) / (nBranches + 1);
+        distance[b] = 1 + b % 8;
+    }
+
+    TraceWriter trace(stdout, binary);
+    uint64_t history = 0;
+    unsigned long long event = 0;
+
+    while (event < nEvents) {
+        unsigned int b = random.below(nBranches);
+
+        /* A loop runs all its iterations at once */
+        unsigned int nOutcomes = kinds[b] == LOOP_BRANCH ? tripCount[b] : 1;
+        for (unsigned int k = 0; k < nOutcomes && event < nEvents; ++k, ++event) {
+            bool outcome;
+            switch (kinds[b]) {
+                case LOOP_BRANCH:
+                    outcome = k + 1 < tripCount[b];
+                    break;
+                case RANDOM_BRANCH:
+                    outcome = random.uniform() < probability[b];
+                    break;
+                default:
+                    outcome = ((history >> (distance[b] - 1)) & 1) ^ (random.uniform() < 0.01);
+                    break;
+            }
+            trace.add(b, outcome);
+            history = (history << 1) | outcome;
+        }
+    }
+
+    return 0;
+}
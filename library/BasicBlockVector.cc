@@ -0,0 +1,212 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/ 
+
+#include "BasicBlockVector.h"
+#include <algorithm>
+#include <limits>
+#include <unistd.h>
+
+// Deterministic projection coefficient in [-1, 1) for a basic block and a dimension
+static double projectionCoefficient(unsigned id, unsigned dimension) {
+    unsigned long long x = ((unsigned long long)id << 8) ^ dimension;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x = x ^ (x >> 31);
+    return (x >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+static double squaredDistance(const vector<double> &a, const vector<double> &b) {
+    double d = 0;
+    for (unsigned i = 0; i < a.size(); i++)
+        d += (a[i] - b[i]) * (a[i] - b[i]);
+    return d;
+}
+
+BasicBlockVector::BasicBlockVector(Module *M, 
+                                   int thread_id, 
+                                   int processor_id, 
+                                   unsigned long long interval_size, 
+                                   const string &filename) :
+    InstructionAnalysis(M, thread_id, processor_id) {
+
+    build_basicblock_index(M);
+
+    this->interval_size = interval_size ? interval_size : BBV_DEFAULT_INTERVAL_SIZE;
+    this->instructions = 0;
+    this->finished = false;
+    this->counts.resize(BasicBlockSizes.size(), 0);
+
+    this->prefix = filename.empty() ? BBV_DEFAULT_FILE : filename;
+    this->prefix += "." + std::to_string(getpid()) + "." + std::to_string(thread_id);
+
+    string name = this->prefix + ".bb";
+    this->out = fopen(name.c_str(), "w");
+    if (!this->out) {
+        fprintf(stderr, "BasicBlockVector: could not open %s, using stderr\n", name.c_str());
+        this->out = stderr;
+    }
+}
+
+BasicBlockVector::~BasicBlockVector() {
+    if (out && out != stderr)
+        fclose(out);
+}
+
+// A block crossing the end of an interval is split between the two, so the
+// interval k starts exactly at instruction k * interval_size
+void BasicBlockVector::visit(int f, int bb) {
+    unsigned id = BasicBlockOffsets[f] + bb;
+    unsigned long long size = BasicBlockSizes[id];
+
+    while (size) {
+        unsigned long long part = min(size, interval_size - instructions);
+
+        if (!counts[id])
+            touched.push_back(id);
+        counts[id] += part;
+        instructions += part;
+        size -= part;
+
+        if (instructions == interval_size)
+            dumpInterval();
+    }
+}
+
+void BasicBlockVector::dumpInterval() {
+    vector<double> projection(BBV_DIMENSIONS, 0);
+
+    std::sort(touched.begin(), touched.end());
+
+    // SimPoint ids start from 1
+    fputc('T', out);
+    for (unsigned i = 0; i < touched.size(); i++) {
+        unsigned id = touched[i];
+        fprintf(out, ":%u:%llu ", id + 1, counts[id]);
+
+        double weight = (double)counts[id] / instructions;
+        for (unsigned d = 0; d < BBV_DIMENSIONS; d++)
+            projection[d] += weight * projectionCoefficient(id, d);
+
+        counts[id] = 0;
+    }
+    fputc('\n', out);
+
+    projections.push_back(projection);
+    touched.clear();
+    instructions = 0;
+}
+
+// k-means over the projected intervals. The initial centers are chosen
+// with the farthest point heuristic, so the result is deterministic.
+void BasicBlockVector::cluster(vector<int> &assignment, vector<unsigned long long> &representatives, int &k) {
+    unsigned long long n = projections.size();
+    k = min((unsigned long long)BBV_MAX_CLUSTERS, n);
+
+    vector<vector<double>> centers;
+    vector<double> closest(n, numeric_limits<double>::max());
+
+    centers.push_back(projections[0]);
+    while ((int)centers.size() < k) {
+        unsigned long long farthest = 0;
+        for (unsigned long long i = 0; i < n; i++) {
+            closest[i] = min(closest[i], squaredDistance(projections[i], centers.back()));
+            if (closest[i] > closest[farthest])
+                farthest = i;
+        }
+        // All the remaining intervals are identical to a center
+        if (closest[farthest] == 0)
+            break;
+        centers.push_back(projections[farthest]);
+    }
+    k = centers.size();
+
+    assignment.assign(n, -1);
+    for (int iteration = 0; iteration < BBV_MAX_ITERATIONS; iteration++) {
+        bool changed = false;
+
+        for (unsigned long long i = 0; i < n; i++) {
+            int best = 0;
+            for (int c = 1; c < k; c++)
+                if (squaredDistance(projections[i], centers[c]) < squaredDistance(projections[i], centers[best]))
+                    best = c;
+            if (assignment[i] != best) {
+                assignment[i] = best;
+                changed = true;
+            }
+        }
+
+        if (!changed)
+            break;
+
+        vector<unsigned long long> sizes(k, 0);
+        for (int c = 0; c < k; c++)
+            centers[c].assign(BBV_DIMENSIONS, 0);
+        for (unsigned long long i = 0; i < n; i++) {
+            sizes[assignment[i]]++;
+            for (unsigned d = 0; d < BBV_DIMENSIONS; d++)
+                centers[assignment[i]][d] += projections[i][d];
+        }
+        for (int c = 0; c < k; c++)
+            if (sizes[c])
+                for (unsigned d = 0; d < BBV_DIMENSIONS; d++)
+                    centers[c][d] /= sizes[c];
+    }
+
+    // The representative of a cluster is the interval closest to its center
+    representatives.assign(k, n);
+    for (unsigned long long i = 0; i < n; i++) {
+        unsigned long long &r = representatives[assignment[i]];
+        if (r == n || squaredDistance(projections[i], centers[assignment[i]]) <
+                      squaredDistance(projections[r], centers[assignment[i]]))
+            r = i;
+    }
+}
+
+void BasicBlockVector::finish() {
+    if (finished)
+        return;
+    finished = true;
+
+    if (instructions)
+        dumpInterval();
+    fflush(out);
+
+    if (projections.empty())
+        return;
+
+    vector<int> assignment;
+    vector<unsigned long long> representatives;
+    int k;
+    cluster(assignment, representatives, k);
+
+    vector<unsigned long long> sizes(k, 0);
+    for (unsigned long long i = 0; i < assignment.size(); i++)
+        sizes[assignment[i]]++;
+
+    FILE *simpoints = fopen((prefix + ".simpoints").c_str(), "w");
+    FILE *weights = fopen((prefix + ".weights").c_str(), "w");
+    if (!simpoints || !weights) {
+        fprintf(stderr, "BasicBlockVector: could not write the simpoints of %s\n", prefix.c_str());
+    } else {
+        for (int c = 0; c < k; c++) {
+            if (!sizes[c])
+                continue;
+            fprintf(simpoints, "%llu %d\n", representatives[c], c);
+            fprintf(weights, "%f %d\n", (double)sizes[c] / assignment.size(), c);
+        }
+    }
+
+    if (simpoints)
+        fclose(simpoints);
+    if (weights)
+        fclose(weights);
+}
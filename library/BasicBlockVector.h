@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/ 
+
+class BasicBlockVector;
+
+#ifndef LLVM_BASIC_BLOCK_VECTOR__H
+#define LLVM_BASIC_BLOCK_VECTOR__H
+
+#include <stdio.h>
+#include <vector>
+
+#include "InstructionAnalysis.h"
+#include "utils.h"
+
+#define BBV_DEFAULT_FILE            "pisa-bbv"
+#define BBV_DEFAULT_INTERVAL_SIZE   100000000
+// Dimensions of the random projection used for clustering (as SimPoint)
+#define BBV_DIMENSIONS              15
+#define BBV_MAX_CLUSTERS            10
+#define BBV_MAX_ITERATIONS          100
+
+// SimPoint-style basic block vectors. Each basic block execution adds its
+// number of (non-phi) instructions to a dense per-thread counter. Every
+// 'interval_size' instructions the non-zero counters are written to
+// <prefix>.<pid>.<tid>.bb in the SimPoint .bb format. At the end, the intervals are clustered with
+// k-means and one representative interval per cluster is written to the
+// .simpoints file, with its weight in the .weights file.
+class BasicBlockVector: public InstructionAnalysis {
+    FILE *out;
+    string prefix;
+    bool finished;
+
+    unsigned long long interval_size;
+    unsigned long long instructions;
+
+    vector<unsigned long long> counts;
+    vector<unsigned> touched;
+
+    // Projected (and normalized) vector of each interval
+    vector<vector<double>> projections;
+
+    void dumpInterval();
+    void cluster(vector<int> &assignment, vector<unsigned long long> &representatives, int &k);
+
+public:
+    BasicBlockVector(Module *M, 
+                     int thread_id, 
+                     int processor_id, 
+                     unsigned long long interval_size, 
+                     const string &filename = "");
+    ~BasicBlockVector();
+
+    void visit(int f, int bb);
+    void finish();
+};
+
+#endif // LLVM_BASIC_BLOCK_VECTOR__H
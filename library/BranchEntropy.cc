@@ -11,43 +11,90 @@
  *******************************************************************************/ 
 
 #include "BranchEntropy.h"
+#include <cmath>
+#include <unistd.h>
+
+unordered_map<Instruction*, BranchEntropy::InstructionID> BranchEntropy::instructionIDs;
+unordered_map<Function*, uint32_t> BranchEntropy::functionIDs;
 
 BranchEntropy::BranchEntropy(Module *M, 
                              pthread_mutex_t *print_lock, 
                              int thread_id, 
                              int processor_id, 
                              bool cond, 
-                             const bool shard_files, 
-                             const string &filename) :
+                             const unsigned long long shard_entries, 
+                             const string &filename,
+                             const unsigned max_history,
+                             const bool binary) :
     InstructionAnalysis(M, thread_id, processor_id),
     shard_files_(false), filename_(filename) {
         
     this->lock = print_lock;
     this->only_cond = cond;
+    this->max_history_ = min(max_history, (unsigned)BRANCH_HISTORY_MAX);
+    this->binary_out_ = NULL;
+    this->max_file_entries_ = shard_entries;
+    this->current_file_entries_ = 0;
+    this->shard_ = 0;
+    this->header_ = false;
+    this->pending_ready_ = false;
+    this->pending_rotate_ = false;
+    this->writer_exit_ = false;
     
-    if (filename.empty()) {
-        out_.reset(&std::cout);
-    } else {
-        out_.reset(new ofstream(filename, std::ofstream::binary | std::ofstream::out));
+    // The online analysis does not write any trace
+    if (!this->max_history_ && binary) {
+        string name = filename.empty() ? BRANCH_TRACE_DEFAULT_FILE : filename;
+        name += "." + std::to_string(getpid()) + "." + std::to_string(thread_id) + ".btrace";
+
+        this->binary_out_ = fopen(name.c_str(), "wb");
+        if (this->binary_out_) {
+            fwrite(BRANCH_TRACE_MAGIC, 1, BRANCH_TRACE_MAGIC_SIZE, this->binary_out_);
+            this->binary_buffer_.reserve(BRANCH_TRACE_BUFFER_RECORDS);
+        } else
+            fprintf(stderr, "BranchEntropy: could not open %s, writing the text trace\n", name.c_str());
+    }
+
+    if (!this->max_history_ && !this->binary_out_) {
+        // Only the trace files can be sharded
+        this->shard_files_ = shard_entries && !filename.empty();
+
+        if (filename.empty()) {
+            out_.reset(&std::cout);
+        } else if (shard_files_) {
+            out_.reset(new ofstream(shardName(0), std::ofstream::binary | std::ofstream::out));
+        } else {
+            out_.reset(new ofstream(filename, std::ofstream::binary | std::ofstream::out));
+        }
+
+        this->buffer_.reserve(max_buffer_size_);
+        this->pending_.reserve(max_buffer_size_);
+        pthread_mutex_init(&this->writer_lock_, NULL);
+        pthread_cond_init(&this->writer_cond_, NULL);
+        pthread_create(&this->writer_, NULL, BranchEntropy::writer, this);
     }
     
     this->M = M;
     static pthread_mutex_t instructionIDs_lock = PTHREAD_MUTEX_INITIALIZER;
     pthread_mutex_lock(&instructionIDs_lock);
 
+    // The table is shared: only the first instance builds it
     if (instructionIDs.empty()) {
         // cerr << "Creating map for branch entropy analysis\n";
         int _f = 0;
+        uint32_t _id = 0;
         for (Module::iterator F = M->begin(); F != M->end(); F++, _f++) {
+            functionIDs[&*F] = _f;
             int _bb = 0;
             for (Function::iterator BB = F->begin(); BB != F->end(); BB++, _bb++) {
                 int _i = 0;
                 for (BasicBlock::iterator Ii = BB->begin(); Ii != BB->end(); Ii++, _i++) {
                     Instruction *J = (Instruction*)Ii;
                     if (isCTRL(J)) {
-                        instructionIDs[J].f = _f;
-                        instructionIDs[J].bb = _bb;
-                        instructionIDs[J].i = _i;
+                        InstructionID &ID = instructionIDs[J];
+                        ID.f = _f;
+                        ID.bb = _bb;
+                        ID.i = _i;
+                        ID.id = _id++;
                     }
                 }
             }
@@ -58,7 +105,25 @@ BranchEntropy::BranchEntropy(Module *M,
 }
 
 BranchEntropy::~BranchEntropy() {
-    *out_.get() << buffer_;
+    if (binary_out_) {
+        flushBinary();
+        fclose(binary_out_);
+    }
+
+    if (out_) {
+        if (!buffer_.empty())
+            handOff(false);
+
+        pthread_mutex_lock(&this->writer_lock_);
+        this->writer_exit_ = true;
+        pthread_cond_broadcast(&this->writer_cond_);
+        pthread_mutex_unlock(&this->writer_lock_);
+        pthread_join(this->writer_, NULL);
+
+        pthread_cond_destroy(&this->writer_cond_);
+        pthread_mutex_destroy(&this->writer_lock_);
+        out_->flush();
+    }
     
     // Avoid doing a delete on the std::cout reference
     if (out_.get() == &std::cout) {
@@ -67,9 +132,74 @@ BranchEntropy::~BranchEntropy() {
 }
 
 void BranchEntropy::printHeader() {
-    pthread_mutex_lock(this->lock);
-    *out_.get() << "| Branch type | Function_ID | BasicBlock_ID | Instruction_ID | T/F | Thread_ID | Processor_ID|\n";
-    pthread_mutex_unlock(this->lock);
+    if (this->max_history_ || this->binary_out_)
+        return;
+
+    this->header_ = true;
+    buffer_ += BRANCH_TRACE_HEADER;
+}
+
+string BranchEntropy::shardName(long shard) {
+    return filename_ + "." + std::to_string(getpid()) + "." + std::to_string(thread_id) + "." + std::to_string(shard);
+}
+
+void *BranchEntropy::writer(void *arg) {
+    BranchEntropy *be = (BranchEntropy *)arg;
+
+    pthread_mutex_lock(&be->writer_lock_);
+    while (1) {
+        while (!be->pending_ready_ && !be->writer_exit_)
+            pthread_cond_wait(&be->writer_cond_, &be->writer_lock_);
+        if (!be->pending_ready_)
+            break;
+        pthread_mutex_unlock(&be->writer_lock_);
+
+        // The threads share stdout
+        bool shared = be->out_.get() == &std::cout;
+        if (shared)
+            pthread_mutex_lock(be->lock);
+        be->out_->write(be->pending_.data(), be->pending_.size());
+        if (shared)
+            pthread_mutex_unlock(be->lock);
+        be->pending_.clear();
+
+        if (be->pending_rotate_) {
+            be->shard_++;
+            be->out_.reset(new ofstream(be->shardName(be->shard_), std::ofstream::binary | std::ofstream::out));
+        }
+
+        pthread_mutex_lock(&be->writer_lock_);
+        be->pending_ready_ = false;
+        pthread_cond_broadcast(&be->writer_cond_);
+    }
+    pthread_mutex_unlock(&be->writer_lock_);
+
+    return NULL;
+}
+
+// Hands buffer_ to the writer thread, once it is done with the previous one
+void BranchEntropy::handOff(bool rotate) {
+    pthread_mutex_lock(&this->writer_lock_);
+    while (this->pending_ready_)
+        pthread_cond_wait(&this->writer_cond_, &this->writer_lock_);
+    this->pending_.swap(buffer_);
+    this->pending_ready_ = true;
+    this->pending_rotate_ = rotate;
+    pthread_cond_broadcast(&this->writer_cond_);
+    pthread_mutex_unlock(&this->writer_lock_);
+}
+
+void BranchEntropy::startEntry() {
+    if (shard_files_ && current_file_entries_ == max_file_entries_) {
+        current_file_entries_ = 0;
+        handOff(true);
+        if (header_)
+            buffer_ += BRANCH_TRACE_HEADER;
+    } else if (buffer_.size() >= max_buffer_size_) {
+        handOff(false);
+    }
+
+    current_file_entries_++;
 }
 
 bool BranchEntropy::isCTRL(Instruction* I) {
@@ -90,18 +220,124 @@ bool BranchEntropy::isCTRL(Instruction* I) {
     return false;
 }
 
-void BranchEntropy::getInstructionIDs(Instruction *I, int *f, int *bb, int *i, Module *M) {
-    if (!M)
+const BranchEntropy::InstructionID &BranchEntropy::getInstructionID(Instruction *I) {
+    auto it = instructionIDs.find(I);
+    assert(it != instructionIDs.end());
+    return it->second;
+}
+
+void BranchEntropy::BranchHistory::add(int outcome, unsigned max_history) {
+    if (patterns.empty())
+        patterns.resize(max_history + 1);
+
+    // Histories of every length already seen, up to max_history
+    unsigned lengths = executions < max_history ? executions : max_history;
+    for (unsigned n = 0; n <= lengths; n++) {
+        unsigned long long mask = n == 64 ? ~0ULL : (1ULL << n) - 1;
+        patterns[n][history & mask].count[outcome]++;
+    }
+
+    history = (history << 1) | outcome;
+    executions++;
+}
+
+void BranchEntropy::TargetHistory::add(uint32_t target, unsigned long long history, unsigned long long length, unsigned max_history) {
+    if (patterns.empty())
+        patterns.resize(max_history + 1);
+
+    // Histories of every length already seen, up to max_history
+    unsigned lengths = length < max_history ? length : max_history;
+    for (unsigned n = 0; n <= lengths; n++) {
+        unsigned long long mask = n == 64 ? ~0ULL : (1ULL << n) - 1;
+        TargetCount &counts = patterns[n][history & mask];
+
+        auto it = counts.begin();
+        while (it != counts.end() && it->first != target)
+            it++;
+        if (it != counts.end())
+            it->second++;
+        else
+            counts.push_back(make_pair(target, 1ULL));
+    }
+
+    executions++;
+}
+
+// Index of the successor of a switch or an indirect branch
+template <typename T>
+static uint32_t successorIndex(T *site, BasicBlock *BB) {
+    for (unsigned s = 0; s < site->getNumSuccessors(); s++)
+        if (site->getSuccessor(s) == BB)
+            return s;
+
+    return BRANCH_TARGET_EXTERNAL;
+}
+
+void BranchEntropy::recordTarget(Instruction &I) {
+    Instruction *site = prevSite;
+    TargetHistory &targets = targets_[site];
+    uint32_t target;
+
+    prevSite = NULL;
+
+    if (SwitchInst *S = dyn_cast<SwitchInst>(site)) {
+        targets.kind = BRANCH_TARGET_SWITCH;
+        target = successorIndex(S, I.getParent());
+    } else if (IndirectBrInst *B = dyn_cast<IndirectBrInst>(site)) {
+        targets.kind = BRANCH_TARGET_INDIRECT;
+        target = successorIndex(B, I.getParent());
+    } else {
+        // A callee that is not analysed returns to the next instruction
+        targets.kind = BRANCH_TARGET_CALL;
+        target = BRANCH_TARGET_EXTERNAL;
+        if (&I != site->getNextNode()) {
+            auto it = functionIDs.find(I.getParent()->getParent());
+            if (it != functionIDs.end())
+                target = it->second;
+        }
+    }
+
+    targets.add(target, global_.history, global_.executions, this->max_history_);
+}
+
+void BranchEntropy::flushBinary() {
+    fwrite(binary_buffer_.data(), sizeof(uint32_t), binary_buffer_.size(), binary_out_);
+    binary_buffer_.clear();
+}
+
+void BranchEntropy::record(const char *type, Instruction *I, int state) {
+    if (this->max_history_) {
+        if (state == 0 || state == 1) {
+            global_.add(state, this->max_history_);
+            branches_[I].add(state, this->max_history_);
+        }
         return;
+    }
 
-    assert(instructionIDs.find(I) != instructionIDs.end());
-    
-    *f = instructionIDs[I].f;
-    *bb = instructionIDs[I].bb;
-    *i = instructionIDs[I].i;
+    if (this->binary_out_) {
+        if (state == 0 || state == 1) {
+            binary_buffer_.push_back((getInstructionID(I).id << 1) | state);
+            if (binary_buffer_.size() == BRANCH_TRACE_BUFFER_RECORDS)
+                flushBinary();
+        }
+        return;
+    }
+
+    const InstructionID &ID = getInstructionID(I);
+
+    startEntry();
+    buffer_ += std::string(type) + " " + std::to_string(ID.f) + " " +
+        std::to_string(ID.bb) + " " +
+        std::to_string(ID.i) + " " +
+        std::to_string(state) + " " +
+        std::to_string(thread_id) + " " +
+        std::to_string(processor_id) + "\n";
 }
 
 void BranchEntropy::visit(Instruction &I) {
+    if (prevSite)
+        recordTarget(I);
+
     if (I.getOpcode() == Instruction::Br) {
         prevB = cast<BranchInst>(&I);
     } else {
@@ -109,45 +345,15 @@ void BranchEntropy::visit(Instruction &I) {
         if (prevB) {
             BasicBlock *currentBB = I.getParent();
             if (prevB->getNumSuccessors() > 2) {
-                pthread_mutex_lock(this->lock);
-                buffer_ += "switch instruction identified in " +
-                    std::to_string(thread_id) + " " +
-                    std::to_string(processor_id) + "\n";
-                    
-                if (shard_files_) {
-                    current_file_entries_++;
-                    if (current_file_entries_ % max_file_entries_ == 0) {
-                        current_file_entries_ = 0;
-                        shard_++;
-                        const string filename = filename_ + std::to_string(shard_);
-                        out_.reset(new std::ofstream(filename.c_str()));
-                    }
+                if (!this->max_history_ && !this->binary_out_) {
+                    startEntry();
+                    buffer_ += "switch instruction identified in " +
+                        std::to_string(thread_id) + " " +
+                        std::to_string(processor_id) + "\n";
                 }
-                
-                pthread_mutex_unlock(this->lock);
             } else if (!this->only_cond && prevB->getNumSuccessors() < 2) {
                 // Unconditional branch
-                int f = -1, bb = -1, i = -1;
-                getInstructionIDs(prevB, &f, &bb, &i, M);
-
-                pthread_mutex_lock(this->lock);
-                buffer_ += "ub " + std::to_string(f) + " " +
-                    std::to_string(bb) + " " +
-                    std::to_string(i) + " 1 " +
-                    std::to_string(thread_id) + " " +
-                    std::to_string(processor_id) + "\n";
-
-                if (shard_files_) {
-                    current_file_entries_++;
-                    if (current_file_entries_ % max_file_entries_ == 0) {
-                        current_file_entries_ = 0;
-                        shard_++;
-                        const string filename = filename_ + std::to_string(shard_);
-                        out_.reset(new std::ofstream(filename.c_str()));
-                    }
-                }
-
-                pthread_mutex_unlock(this->lock);
+                record("ub", prevB, 1);
             } else if (prevB->getNumSuccessors() == 2) {
                 int state = -1;
                 if (currentBB == prevB->getSuccessor(0))
@@ -155,29 +361,7 @@ void BranchEntropy::visit(Instruction &I) {
                 else if (currentBB == prevB->getSuccessor(1))
                     state = 0;
                 
-                int f = -1, bb = -1, i = -1;
-                getInstructionIDs(prevB, &f, &bb, &i, M);
-
-                pthread_mutex_lock(this->lock);
-                buffer_ += "cb " + std::to_string(f) + " " +
-                    std::to_string(bb) + " " +
-                    std::to_string(i) + " " +
-                    std::to_string(state) + " " +
-                    std::to_string(thread_id) +
-                    " " + std::to_string(processor_id) +
-                    "\n";
-                    
-                if (shard_files_) {
-                    current_file_entries_++;
-                    if (current_file_entries_ % max_file_entries_ == 0) {
-                        current_file_entries_ = 0;
-                        shard_++;
-                        const string filename = filename_ + std::to_string(shard_);
-                        out_.reset(new std::ofstream(filename.c_str()));
-                    }
-                }
-
-                pthread_mutex_unlock(this->lock); 
+                record("cb", prevB, state);
             }
 
             prevB = NULL;
@@ -185,83 +369,265 @@ void BranchEntropy::visit(Instruction &I) {
 
         if (!this->only_cond && I.getOpcode() == Instruction::Ret) {
             // Return instruction
-            int f = -1, bb = -1, i = -1;
-            getInstructionIDs(&I, &f, &bb, &i, M);
-
-            pthread_mutex_lock(this->lock);
-            buffer_ += "rint " + std::to_string(f) + " " +
-                std::to_string(bb) + " " + std::to_string(i) +
-                " 1 " + std::to_string(thread_id) + " " +
-                std::to_string(processor_id) + "\n";
-                
-            if (shard_files_) {
-                current_file_entries_++;
-                if (current_file_entries_ % max_file_entries_ == 0) {
-                    current_file_entries_ = 0;
-                    shard_++;
-                    const string filename = filename_ + std::to_string(shard_);
-                    out_.reset(new std::ofstream(filename.c_str()));
-                }
-            }
-
-            pthread_mutex_unlock(this->lock);
+            record("rint", &I, 1);
         } else if (!this->only_cond && I.getOpcode() == Instruction::Call) {
             // Call  instruction
-            int f = -1, bb = -1, i = -1;
-            getInstructionIDs(&I, &f, &bb, &i, M);
-
-            pthread_mutex_lock(this->lock);
-            buffer_ += "call " + std::to_string(f) + " " +
-                std::to_string(bb) + " " + std::to_string(i) +
-                " 1 " + std::to_string(thread_id) + " " +
-                std::to_string(processor_id) + "\n";
-                
-            if (shard_files_) {
-                current_file_entries_++;
-                if (current_file_entries_ % max_file_entries_ == 0) {
-                    current_file_entries_ = 0;
-                    shard_++;
-                    const string filename = filename_ + std::to_string(shard_);
-                    out_.reset(new std::ofstream(filename.c_str()));
-                }
-            }
-
-            pthread_mutex_unlock(this->lock);
+            record("call", &I, 1);
 
             // if the call is to an external function, also add the branch
             // corresponding with the return instruction
             CallInst *call = cast<CallInst>(&I);
             Function *_call = get_calledFunction(call);
-            if (_call && _call->begin() == _call->end()) {
-                pthread_mutex_lock(this->lock);
-                buffer_ += "rext " + std::to_string(f) + " " +
-                    std::to_string(bb) + " " +
-                    std::to_string(i) +
-                    " 1 " + std::to_string(thread_id) +
-                    " " + std::to_string(processor_id) +
-                    "\n";
-
-                if (shard_files_) {
-                    current_file_entries_++;
-                    if (current_file_entries_ % max_file_entries_ == 0) {
-                        current_file_entries_ = 0;
-                        shard_++;
-                        const string filename = filename_ + std::to_string(shard_);
-                        out_.reset(new std::ofstream(filename.c_str()));
-                    }
-                }
+            if (_call && _call->begin() == _call->end())
+                record("rext", &I, 1);
+        }
+    }
+
+    // The next analysed instruction gives the target of a multi-target site
+    if (this->max_history_) {
+        if (isa<SwitchInst>(I) || isa<IndirectBrInst>(I)) {
+            prevSite = &I;
+        } else if (CallInst *call = dyn_cast<CallInst>(&I)) {
+            if (!get_calledFunction(call) && !call->isInlineAsm())
+                prevSite = &I;
+        }
+    }
+}
+
+void BranchEntropy::metrics(const BranchHistory &branch, unsigned length, double &entropy, double &predictionRate) {
+    unsigned long long total = 0;
+    double predicted = 0;
 
-                pthread_mutex_unlock(this->lock);
+    // The (length)-grams are the histories of length-1 followed by an outcome
+    entropy = 0;
+    for (auto it = branch.patterns[length - 1].begin(); it != branch.patterns[length - 1].end(); it++)
+        total += it->second.count[0] + it->second.count[1];
+    for (auto it = branch.patterns[length - 1].begin(); it != branch.patterns[length - 1].end(); it++)
+        for (int outcome = 0; outcome < 2; outcome++)
+            if (it->second.count[outcome]) {
+                double p = (double)it->second.count[outcome] / total;
+                entropy -= p * log2(p);
             }
+
+    // Max-outcome: each history predicts its most frequent outcome
+    total = 0;
+    for (auto it = branch.patterns[length].begin(); it != branch.patterns[length].end(); it++) {
+        predicted += max(it->second.count[0], it->second.count[1]);
+        total += it->second.count[0] + it->second.count[1];
+    }
+    predictionRate = total ? predicted / total : -1;
+}
+
+void BranchEntropy::targetMetrics(const TargetHistory &site, unsigned length, double &entropy, double &predictionRate) {
+    unsigned long long total = 0;
+    double predicted = 0;
+
+    for (auto it = site.patterns[length].begin(); it != site.patterns[length].end(); it++)
+        for (auto &target : it->second)
+            total += target.second;
+
+    // Conditional entropy: each history weighted by its frequency
+    entropy = 0;
+    for (auto it = site.patterns[length].begin(); it != site.patterns[length].end(); it++) {
+        unsigned long long count = 0, best = 0;
+        for (auto &target : it->second) {
+            count += target.second;
+            best = max(best, target.second);
         }
+        for (auto &target : it->second)
+            entropy -= (double)target.second / total * log2((double)target.second / count);
+        predicted += best;
     }
-    
-    pthread_mutex_lock(this->lock);
+    predictionRate = total ? predicted / total : -1;
+}
 
-    if (buffer_.size() >= max_buffer_size_) {
-        *out_.get() << buffer_;
-        buffer_ = "";
+void BranchEntropy::JSONdump(JSONmanager *JSONwriter) {
+    if (!this->max_history_)
+        return;
+
+    JSONwriter->String("branchEntropy");
+    JSONwriter->StartObject();
+
+    JSONwriter->String("maxHistoryLength");
+    JSONwriter->Uint64(this->max_history_);
+    JSONwriter->String("branchExecutions");
+    JSONwriter->Uint64(global_.executions);
+    JSONwriter->String("staticBranches");
+    JSONwriter->Uint64(branches_.size());
+
+    // All the outcomes of the thread as a single stream
+    JSONwriter->String("global");
+    JSONwriter->StartArray();
+    double previous = 0;
+    for (unsigned n = 1; n <= this->max_history_ && global_.executions > n; n++) {
+        double entropy, predictionRate;
+        metrics(global_, n, entropy, predictionRate);
+
+        JSONwriter->StartObject();
+        JSONwriter->String("historyLength");
+        JSONwriter->Uint64(n);
+        JSONwriter->String("entropy");
+        JSONwriter->Double(entropy);
+        JSONwriter->String("difference");
+        JSONwriter->Double(max(entropy - previous, 0.0));
+        JSONwriter->String("mispredictionRate");
+        JSONwriter->Double(1 - predictionRate);
+        JSONwriter->String("historyPatterns");
+        JSONwriter->Uint64(global_.patterns[n].size());
+        JSONwriter->EndObject();
+
+        previous = entropy;
     }
+    JSONwriter->EndArray();
+
+    // Per branch, averaged weighting by the executions. As branchBehavior,
+    // only the branches executed more than max_history_ times are included.
+    JSONwriter->String("local");
+    JSONwriter->StartArray();
+    vector<double> sumEntropy(this->max_history_ + 1, 0);
+    vector<double> sumDifference(this->max_history_ + 1, 0);
+    vector<double> sumPredictionRate(this->max_history_ + 1, 0);
+    unsigned long long total = 0;
+
+    for (auto it = branches_.begin(); it != branches_.end(); it++) {
+        if (it->second.executions <= this->max_history_)
+            continue;
+
+        previous = 0;
+        for (unsigned n = 1; n <= this->max_history_; n++) {
+            double entropy, predictionRate;
+            metrics(it->second, n, entropy, predictionRate);
+
+            sumEntropy[n] += entropy * it->second.executions;
+            sumDifference[n] += max(entropy - previous, 0.0) * it->second.executions;
+            sumPredictionRate[n] += predictionRate * it->second.executions;
+            previous = entropy;
+        }
+        total += it->second.executions;
+    }
+
+    for (unsigned n = 1; n <= this->max_history_ && total; n++) {
+        JSONwriter->StartObject();
+        JSONwriter->String("historyLength");
+        JSONwriter->Uint64(n);
+        JSONwriter->String("entropy");
+        JSONwriter->Double(sumEntropy[n] / total);
+        JSONwriter->String("difference");
+        JSONwriter->Double(sumDifference[n] / total);
+        JSONwriter->String("mispredictionRate");
+        JSONwriter->Double(1 - sumPredictionRate[n] / total);
+        JSONwriter->EndObject();
+    }
+    JSONwriter->EndArray();
+
+    dumpTargets(JSONwriter);
+
+    JSONwriter->EndObject();
+}
 
-    pthread_mutex_unlock(this->lock);
+void BranchEntropy::dumpTargets(JSONmanager *JSONwriter) {
+    static const char *kinds[BRANCH_TARGET_KINDS] = {"switch", "indirectBranch", "indirectCall"};
+
+    // The sites in module order
+    vector<pair<uint32_t, Instruction*>> sites;
+    for (auto it = targets_.begin(); it != targets_.end(); it++)
+        sites.push_back(make_pair(getInstructionID(it->first).id, it->first));
+    std::sort(sites.begin(), sites.end());
+
+    // Per kind of site, averaged weighting by the executions
+    JSONwriter->String("targets");
+    JSONwriter->StartArray();
+    for (int kind = 0; kind < BRANCH_TARGET_KINDS; kind++) {
+        vector<double> sumEntropy(this->max_history_ + 1, 0);
+        vector<double> sumPredictionRate(this->max_history_ + 1, 0);
+        unsigned long long total = 0, count = 0;
+
+        for (auto &site : sites) {
+            const TargetHistory &targets = targets_[site.second];
+            if (targets.kind != kind)
+                continue;
+
+            for (unsigned n = 0; n <= this->max_history_; n++) {
+                double entropy, predictionRate;
+                targetMetrics(targets, n, entropy, predictionRate);
+                sumEntropy[n] += entropy * targets.executions;
+                sumPredictionRate[n] += max(predictionRate, 0.0) * targets.executions;
+            }
+            total += targets.executions;
+            count++;
+        }
+
+        JSONwriter->StartObject();
+        JSONwriter->String("kind");
+        JSONwriter->String(kinds[kind]);
+        JSONwriter->String("sites");
+        JSONwriter->Uint64(count);
+        JSONwriter->String("executions");
+        JSONwriter->Uint64(total);
+        JSONwriter->String("history");
+        JSONwriter->StartArray();
+        for (unsigned n = 0; n <= this->max_history_ && total; n++) {
+            JSONwriter->StartObject();
+            JSONwriter->String("historyLength");
+            JSONwriter->Uint64(n);
+            JSONwriter->String("entropy");
+            JSONwriter->Double(sumEntropy[n] / total);
+            JSONwriter->String("mispredictionRate");
+            JSONwriter->Double(1 - sumPredictionRate[n] / total);
+            JSONwriter->EndObject();
+        }
+        JSONwriter->EndArray();
+        JSONwriter->EndObject();
+    }
+    JSONwriter->EndArray();
+
+    // Target histogram of every site
+    JSONwriter->String("targetSites");
+    JSONwriter->StartArray();
+    for (auto &site : sites) {
+        const TargetHistory &targets = targets_[site.second];
+        const InstructionID &ID = getInstructionID(site.second);
+        double entropy, predictionRate;
+        targetMetrics(targets, 0, entropy, predictionRate);
+
+        TargetCount histogram = targets.patterns[0].begin()->second;
+        std::sort(histogram.begin(), histogram.end());
+
+        JSONwriter->StartObject();
+        JSONwriter->String("kind");
+        JSONwriter->String(kinds[targets.kind]);
+        JSONwriter->String("function");
+        JSONwriter->Uint64(ID.f);
+        JSONwriter->String("basicBlock");
+        JSONwriter->Uint64(ID.bb);
+        JSONwriter->String("instruction");
+        JSONwriter->Uint64(ID.i);
+        JSONwriter->String("executions");
+        JSONwriter->Uint64(targets.executions);
+        JSONwriter->String("entropy");
+        JSONwriter->Double(entropy);
+        JSONwriter->String("targets");
+        JSONwriter->StartArray();
+        unsigned long long external = 0;
+        for (auto &target : histogram) {
+            if (target.first == BRANCH_TARGET_EXTERNAL) {
+                external = target.second;
+                continue;
+            }
+            JSONwriter->StartObject();
+            JSONwriter->String("target");
+            JSONwriter->Uint64(target.first);
+            JSONwriter->String("count");
+            JSONwriter->Uint64(target.second);
+            JSONwriter->EndObject();
+        }
+        JSONwriter->EndArray();
+        // Indirect calls to functions that are not analysed
+        if (targets.kind == BRANCH_TARGET_CALL) {
+            JSONwriter->String("externalTargets");
+            JSONwriter->Uint64(external);
+        }
+        JSONwriter->EndObject();
+    }
+    JSONwriter->EndArray();
 }
@@ -10,6 +10,8 @@
  *    IBM Algorithms & Machines team
  *******************************************************************************/ 
 
+class BranchEntropy;
+
 #ifndef LLVM_BRANCH_ENTROPY__H
 #define LLVM_BRANCH_ENTROPY__H
 
@@ -18,15 +20,46 @@
 #include <memory>
 #include <ostream>
 #include <pthread.h> 
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
 
 #include "InstructionAnalysis.h"
 #include "utils.h"
+#include "JSONmanager.h"
+
+// Longest history supported by the online branch entropy
+#define BRANCH_HISTORY_MAX 64
+
+// Sites with several targets followed by the online target entropy
+#define BRANCH_TARGET_SWITCH    0
+#define BRANCH_TARGET_INDIRECT  1
+#define BRANCH_TARGET_CALL      2
+#define BRANCH_TARGET_KINDS     3
+// Target of an indirect call to a function that is not analysed
+#define BRANCH_TARGET_EXTERNAL  0xFFFFFFFFU
+
+// Binary branch trace (BRANCH_TRACE_BINARY): one file per thread,
+// <filename>.<pid>.<thread_id>.btrace, starting with BRANCH_TRACE_MAGIC and
+// followed by one 32-bit record per executed branch: (id << 1) | outcome.
+// The id numbers the control instructions of the module in order.
+#define BRANCH_TRACE_MAGIC          "PISABRT1"
+#define BRANCH_TRACE_MAGIC_SIZE     8
+#define BRANCH_TRACE_DEFAULT_FILE   "pisa-branches"
+#define BRANCH_TRACE_BUFFER_RECORDS (1 << 18)
+
+// Text trace: the header line, then one line per executed branch. The
+// lines go through two buffers of BRANCH_TRACE_BUFFER_SIZE bytes.
+#define BRANCH_TRACE_HEADER         "| Branch type | Function_ID | BasicBlock_ID | Instruction_ID | T/F | Thread_ID | Processor_ID|\n"
+#define BRANCH_TRACE_BUFFER_SIZE    (1 << 20)
 
 class BranchEntropy: public InstructionAnalysis {
     typedef struct {
         int f;
         int bb;
         int i;
+        uint32_t id;
     } InstructionID;
 
     pthread_mutex_t *lock;
@@ -36,17 +69,17 @@ class BranchEntropy: public InstructionAnalysis {
     bool shard_files_;
     
     // The output stream where the branch entropy is dumped. It can be
-    // a file or stdout. The default value is stdout.
+    // a file or stdout. The default value is stdout. Only the writer thread
+    // uses it.
     std::unique_ptr<std::ostream> out_;
     
-    // The threshold for the maximum entries allowed in a file. This is used
-    // only if the output stream is different than stdout. If this threshold
-    // is reached and shard_files_ is true, then the files are sharded. The
-    // name of a shard is given by the name of the file and the shard number.
-    const long int max_file_entries_ = 100000;
+    // The threshold for the maximum entries allowed in a file. If this
+    // threshold is reached and shard_files_ is true, then the next entries go
+    // to a new file: <filename>.<pid>.<thread_id>.<shard number>.
+    unsigned long long max_file_entries_;
     
     // The number of entries currently dumped in the file.
-    long int current_file_entries_;
+    unsigned long long current_file_entries_;
     
     // Output file name. This value should be empty if the output stream is stdout.
     const string filename_;
@@ -54,23 +87,112 @@ class BranchEntropy: public InstructionAnalysis {
     // The shard number of the output file.
     long shard_;
     
-    // Used for buffering debugging information.
+    // The trace lines not yet handed to the writer thread.
     std::string buffer_;
     
-    // The maximum size of the debugging buffer. The buffer is logged when
-    // the buffer reaches this size.
-    const unsigned long max_buffer_size_ = 8192;
+    // The buffer is handed to the writer thread when it reaches this size.
+    const unsigned long max_buffer_size_ = BRANCH_TRACE_BUFFER_SIZE;
+
+    // Whether each file starts with the header line.
+    bool header_;
+
+    // Writer thread of the text trace. The analysis thread fills buffer_ and
+    // swaps it with pending_, which the writer writes out; it only waits if
+    // the writer is still busy with the previous buffer.
+    pthread_t writer_;
+    pthread_mutex_t writer_lock_;
+    pthread_cond_t writer_cond_;
+    std::string pending_;
+    bool pending_ready_;
+    // Start the next shard after writing pending_
+    bool pending_rotate_;
+    bool writer_exit_;
+
+    static void *writer(void *arg);
+    void handOff(bool rotate);
+    // Called before a trace line is added to buffer_: starts the next
+    // shard or hands the full buffer to the writer
+    void startEntry();
+    string shardName(long shard);
     
     BranchInst *prevB = NULL;
     Module *M;
-    map<Instruction*, InstructionID> instructionIDs;
 
-    // This function returns (via arguments) the function_id,
-    // the basicblock_id and the instruction_id of a given LLVM instruction
-    void getInstructionIDs(Instruction *I, int *f, int *bb, int *i, Module *M);
+    // The ids of the control instructions of the module, built by the first
+    // instance and then only read, by all the threads
+    static unordered_map<Instruction*, InstructionID> instructionIDs;
+
+    // Outcomes that followed one history: count[0] false, count[1] true
+    typedef struct {
+        unsigned long long count[2];
+    } OutcomeCount;
+
+    // Online branch entropy of one outcome stream (a branch or the thread).
+    // patterns[n] counts the outcomes following each history of length n.
+    struct BranchHistory {
+        unsigned long long history; // last outcomes, the most recent in bit 0
+        unsigned long long executions;
+        vector<unordered_map<unsigned long long, OutcomeCount>> patterns;
+
+        BranchHistory() : history(0), executions(0) {}
+        void add(int outcome, unsigned max_history);
+    };
+
+    // Targets that followed one history: (target, count) pairs, usually few
+    typedef vector<pair<uint32_t, unsigned long long>> TargetCount;
+
+    // Online target entropy of a switch, an indirect branch or an indirect
+    // call. patterns[n] counts the targets following each global history of
+    // length n; patterns[0][0] is the target histogram. A switch target is
+    // the successor index, a call target the function id.
+    struct TargetHistory {
+        int kind;
+        unsigned long long executions;
+        vector<unordered_map<unsigned long long, TargetCount>> patterns;
+
+        TargetHistory() : kind(BRANCH_TARGET_SWITCH), executions(0) {}
+        void add(uint32_t target, unsigned long long history, unsigned long long length, unsigned max_history);
+    };
+
+    // The site whose target is the next analysed instruction
+    Instruction *prevSite = NULL;
+    unordered_map<Instruction*, TargetHistory> targets_;
+
+    // Ids of the functions of the module, shared as instructionIDs
+    static unordered_map<Function*, uint32_t> functionIDs;
+
+    // Adds the target of prevSite, reached by I, to the target entropy
+    void recordTarget(Instruction &I);
+
+    // Entropy of the target given the histories of the given length and
+    // max-outcome prediction rate of the target (-1 without data)
+    void targetMetrics(const TargetHistory &site, unsigned length, double &entropy, double &predictionRate);
+    // Writes the "targets" and "targetSites" members of the JSON output
+    void dumpTargets(JSONmanager *JSONwriter);
+
+    // Per-thread binary trace; no lock is taken to write it
+    FILE *binary_out_;
+    vector<uint32_t> binary_buffer_;
+    void flushBinary();
+
+    // Longest history of the online analysis; 0 writes the trace instead
+    unsigned max_history_;
+    BranchHistory global_;
+    unordered_map<Instruction*, BranchHistory> branches_;
+
+    // The function_id, the basicblock_id, the instruction_id and the dense
+    // id of a control instruction
+    const InstructionID &getInstructionID(Instruction *I);
 
     bool isCTRL(Instruction* I);
 
+    // Either adds the outcome to the online analysis or writes the trace line
+    void record(const char *type, Instruction *I, int state);
+
+    // Metrics of the histories of the given length: entropy of the
+    // (length)-grams and max-outcome prediction rate (-1 without data)
+    void metrics(const BranchHistory &branch, unsigned length, double &entropy, double &predictionRate);
+
 
 public:
     BranchEntropy(Module *M, 
@@ -78,12 +200,15 @@ public:
                   int thread_id, 
                   int processor_id, 
                   bool cond, 
-                  const bool shard_files = false, 
-                  const string &filename = "");
+                  const unsigned long long shard_entries = 0, 
+                  const string &filename = "",
+                  const unsigned max_history = 0,
+                  const bool binary = false);
                   
     ~BranchEntropy();
     void visit(Instruction &I);
     void printHeader();
+    void JSONdump(JSONmanager *JSONwriter);
 };
 
 #endif // LLVM_BRANCH_ENTROPY__H
@@ -31,6 +31,12 @@ DataTempReuse::DataTempReuse(Module *M,
     this->DistanceTree = NULL;
     this->mem_footprint = mem_footprint;
     this->print_lock = print_lock;
+    this->record = true;
+
+    // The shards only follow the cache lines: the byte granularity distance
+    // and the memory footprint need the complete access history
+    if (dtr_shards > 1 && data_cache_line_size && !mem_footprint)
+        this->sharded.reset(new ShardedReuse(dtr_shards));
 }
 
 DataTempReuse::~DataTempReuse() {
@@ -42,6 +48,8 @@ void DataTempReuse::JSONdump(JSONmanager *JSONwriter,
                              unsigned long long sharedBytesAcrossThreads, 
                              unsigned long long sharedAccessesAcrossThreads) {
 
+    flush();
+
     // Several space problems when using resolution (otherwise power of 2 is efficient)                             
     bool compressOutput = resolution > 0; 
     
@@ -146,6 +154,11 @@ void DataTempReuse::visit(Instruction &I, unsigned long long CurrentIssueCycle)
     else
         MemoryAddress = MemoryAddressReal;
 
+    if (this->sharded) {
+        this->sharded->access(MemoryAddress, record, this);
+        return;
+    }
+
     bool found = false;
     unsigned long long distance = 0;
     unsigned long long PreviousIssueCycle = 0;
@@ -211,20 +224,28 @@ void DataTempReuse::visit(Instruction &I, unsigned long long CurrentIssueCycle)
     else
         DistanceTree = Insert(CurrentIssueCycle, DistanceTree);
    
+    // If the memory access was previously accessed then update
+    // the reuse distribution tree.
+    if (found && record)
+        addDistance(distance);
+}
+
+void DataTempReuse::addDistance(unsigned long long distance) {
     if ((distance > resolution_final_bin) || (resolution < 1))
         distance = upperPowerOfTwo(distance);
     else
         distance = distance + (resolution - (distance % resolution));
 
-    if (found) {
-        // If the memory access was previously accessed then update
-        // the reuse distribution tree.
-        const auto it = DistanceDistributionMap.find(distance);
-        if (it == DistanceDistributionMap.end())
-            DistanceDistributionMap.insert(pair<unsigned long long, unsigned long long>(distance, 1));
-        else
-            it->second++;
-    }
+    const auto it = DistanceDistributionMap.find(distance);
+    if (it == DistanceDistributionMap.end())
+        DistanceDistributionMap.insert(pair<unsigned long long, unsigned long long>(distance, 1));
+    else
+        it->second++;
+}
+
+void DataTempReuse::flush() {
+    if (this->sharded)
+        this->sharded->flush(this);
 }
 
 // This function is used for the memory footprint analysis.
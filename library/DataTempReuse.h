@@ -18,9 +18,11 @@ class DataTempReuse;
 #include "InstructionAnalysis.h"
 #include "utils.h"
 #include "splay.h"
+#include "ShardedReuse.h"
 #include "JSONmanager.h"
 
 #include<pthread.h>
+#include <memory>
 
 class DataTempReuse: public InstructionAnalysis {
 
@@ -52,6 +54,12 @@ public:
 
     pthread_mutex_t* print_lock;
 
+    // When false, accesses only update the reuse state (fast-forward warm-up)
+    bool record;
+
+    // Experimental parallel reuse distance (dtr_shards > 1)
+    std::unique_ptr<ShardedReuse> sharded;
+
     DataTempReuse(Module *M, 
                   int data_cache_line_size, 
                   int data_reuse_distance_resolution,
@@ -64,6 +72,9 @@ public:
     ~DataTempReuse();
 
     void visit(Instruction &I, unsigned long long CurrentIssueCycle);
+    void addDistance(unsigned long long distance);
+    // Resolves the accesses still pending in the sharded reuse distance
+    void flush();
     
     void JSONdump(JSONmanager *JSONwriter, 
                   unsigned long long norm, 
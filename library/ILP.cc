@@ -50,15 +50,22 @@ ILP::ILP(Module *M, int thread_id, int processor_id, int flags, int ilp_type,
         this->MaxIssueCycleFloatingPointInOrder = 0;
         this->PreviousIssueCycleFloatingPointInOrder = 0;
         
+        this->distribution_base_cycle = 0;
+        if (flags & ANALYZE_ILP_CRITICAL_PATH)
+            this->CriticalPathAddresses.resize(CRITICAL_PATH_MEMORY_ENTRIES, CriticalPathMemory());
+
         prevBB = NULL;
         valueStarCount = 0;
 }
 
 void ILP::visit(Instruction &I) {
+    visit(I, this->getInstType(I));
+}
+
+// InstType is the classification of I returned by getInstType
+void ILP::visit(Instruction &I, int InstType) {
     struct twoValues IssueCycle;
     static int c = 0;
-    unsigned InstType = this->getInstType(I);
-    raw_os_ostream myCout(cerr);
 
     IssueCycle.value1 = 0;
     IssueCycle.value2 = 0;
@@ -99,25 +106,31 @@ void ILP::visit(Instruction &I) {
     // the value returned by a call instruction.
     InsertOperandUsage(&I, IssueCycle, false);
 
+    if ((flags & ANALYZE_ILP_CRITICAL_PATH) && IssueCycle.value1 >= MaxIssueCycle)
+        CriticalPathHead = LookupCriticalPath(&I);
+
     MaxIssueCycle = max(MaxIssueCycle, IssueCycle.value1);
     MaxIssueCycleInOrder = max(MaxIssueCycleInOrder, IssueCycle.value2);
 
-    if (isOfMemoryType(I)) {
+    if ((flags & ANALYZE_ILP_VERBOSE) && window_size)
+        updateDistribution(IssueCycle.value1, InstType == CTRL_TYPE);
+
+    if (isOfMemoryType(InstType)) {
         if (IssueCycle.value1 > PreviousIssueCycleMemory) MaxIssueCycleMemory++;
         PreviousIssueCycleMemory = max(IssueCycle.value1, PreviousIssueCycleMemory);
         if (IssueCycle.value2 > PreviousIssueCycleMemoryInOrder) MaxIssueCycleMemoryInOrder++;
         PreviousIssueCycleMemoryInOrder = max(IssueCycle.value2, PreviousIssueCycleMemoryInOrder);
-    } else if (isOfIntegerType(I)) {
+    } else if (isOfIntegerType(InstType)) {
         if (IssueCycle.value1 > PreviousIssueCycleInteger) MaxIssueCycleInteger++;
         PreviousIssueCycleInteger = max(IssueCycle.value1, PreviousIssueCycleInteger);
         if (IssueCycle.value2 > PreviousIssueCycleIntegerInOrder) MaxIssueCycleIntegerInOrder++;
         PreviousIssueCycleIntegerInOrder = max(IssueCycle.value2, PreviousIssueCycleIntegerInOrder);
-    } else if (isOfControlType(I)) {
+    } else if (isOfControlType(InstType)) {
         if (IssueCycle.value1 > PreviousIssueCycleControl) MaxIssueCycleControl++;
         PreviousIssueCycleControl = max(IssueCycle.value1, PreviousIssueCycleControl);
         if (IssueCycle.value2 > PreviousIssueCycleControlInOrder) MaxIssueCycleControlInOrder++;
         PreviousIssueCycleControlInOrder = max(IssueCycle.value2, PreviousIssueCycleControlInOrder);
-    } else if (isOfFloatingPointType(I)) {
+    } else if (isOfFloatingPointType(InstType)) {
         if (IssueCycle.value1 > PreviousIssueCycleFloatingPoint) MaxIssueCycleFloatingPoint++;
         PreviousIssueCycleFloatingPoint = max(IssueCycle.value1, PreviousIssueCycleFloatingPoint);
         if (IssueCycle.value2 > PreviousIssueCycleFloatingPointInOrder) MaxIssueCycleFloatingPointInOrder++;
@@ -164,7 +177,7 @@ void ILP::visit(Instruction &I) {
     
     if ((flags & PRINT_DEBUG)) {
         pthread_mutex_lock(output_lock);
-        cerr << c << " : "; I.print(myCout); cerr << "\n";
+        cerr << c << " : "; I.print(errs()); cerr << "\n";
         cerr << " procId=" << processor_id 
              << " threadId=" << thread_id 
              << " code=" << I.getOpcodeName()  
@@ -247,6 +260,25 @@ void ILP::JSONdump(JSONmanager *JSONwriter, InstructionMix *mix) {
         
     JSONwriter->EndObject();
 
+    if ((flags & ANALYZE_ILP_VERBOSE) && window_size) {
+        // Flush the cycles still open, up to the span
+        foldDistribution(MaxIssueCycle + 1);
+
+        JSONwriter->String("distribution");
+        JSONwriter->StartObject();
+
+            JSONwriter->String("all");
+            JSONdumpDistribution(JSONwriter, CDF);
+            JSONwriter->String("ctrl");
+            JSONdumpDistribution(JSONwriter, CDF_ctrl);
+            JSONwriter->String("non_ctrl");
+            JSONdumpDistribution(JSONwriter, CDF_non_ctrl);
+
+        JSONwriter->EndObject();
+    }
+
+    if (flags & ANALYZE_ILP_CRITICAL_PATH)
+        JSONdumpCriticalPath(JSONwriter);
         
     // In-order ILP information
     JSONwriter->String("in-order");
@@ -307,6 +339,80 @@ void ILP::JSONdump(JSONmanager *JSONwriter, InstructionMix *mix) {
     JSONwriter->EndArray();
 }
 
+unsigned long long ILP::getSpan() {
+    return MaxIssueCycle + 1;
+}
+
+unsigned long long ILP::getSpanInOrder() {
+    return MaxIssueCycleInOrder + 1;
+}
+
+// Only computed with a scheduler window: no instruction issues before
+// window_cycle, so the older cycles are final and folded into the
+// histograms. Every open cycle holds an instruction still in the scheduler,
+// so at most window_size cycles are kept. With an infinite window any
+// instruction may issue at an early cycle and the distribution would need
+// every cycle of the run.
+void ILP::updateDistribution(unsigned long long cycle, bool isCtrl) {
+    struct twoValues &issued = IssuedPerCycle[cycle];
+
+    if (isCtrl)
+        issued.value1++;
+    else
+        issued.value2++;
+
+    foldDistribution(window_cycle);
+}
+
+// Fold all the cycles older than 'cycle' into the histograms.
+void ILP::foldDistribution(unsigned long long cycle) {
+    if (cycle <= distribution_base_cycle)
+        return;
+
+    unsigned long long idle = 0;
+    auto it = IssuedPerCycle.begin();
+
+    for (; it != IssuedPerCycle.end() && it->first < cycle; it++) {
+        // Cycles in between did not issue any instruction
+        idle += it->first - distribution_base_cycle;
+        distribution_base_cycle = it->first + 1;
+
+        CDF[it->second.value1 + it->second.value2]++;
+        CDF_ctrl[it->second.value1]++;
+        CDF_non_ctrl[it->second.value2]++;
+    }
+    IssuedPerCycle.erase(IssuedPerCycle.begin(), it);
+
+    idle += cycle - distribution_base_cycle;
+    distribution_base_cycle = cycle;
+
+    if (idle) {
+        CDF[0] += idle;
+        CDF_ctrl[0] += idle;
+        CDF_non_ctrl[0] += idle;
+    }
+}
+
+// Emits [instructions per cycle, fraction of cycles with at most that many instructions]
+void ILP::JSONdumpDistribution(JSONmanager *JSONwriter, map<unsigned long long, unsigned long long> &distribution) {
+    map<unsigned long long, unsigned long long>::iterator it;
+    unsigned long long total = 0;
+    unsigned long long sum = 0;
+
+    for (it = distribution.begin(); it != distribution.end(); it++)
+        total += it->second;
+
+    JSONwriter->StartArray();
+    for (it = distribution.begin(); it != distribution.end(); it++) {
+        sum += it->second;
+        JSONwriter->StartArray();
+        JSONwriter->Uint64(it->first);
+        JSONwriter->Double(double4((double)sum / total));
+        JSONwriter->EndArray();
+    }
+    JSONwriter->EndArray();
+}
+
 struct twoValues ILP::LookupOperand(Value *op) {
     struct twoValues IssueCycle;
     IssueCycle.value1 = 0;
@@ -335,7 +441,8 @@ unsigned long long ILP::LookupValueStarIndex(Value *op) {
     return valueStar;
 }
 
-void ILP::InsertOperandUsage(Value *op, struct twoValues IssueCycle, bool isNewInstruction, Value* previousOpForCount) {
+// Address is the memory address of a load or store instruction op
+void ILP::InsertOperandUsage(Value *op, struct twoValues IssueCycle, bool isNewInstruction, Value* previousOpForCount, void *Address) {
     //cout << "Inserting usage for op=" << op << " at cycle=" << IssueCycle << endl;
     map <Value*, valueStarIndex>::iterator it;
     valueStarIndex newInstruction;
@@ -365,11 +472,164 @@ void ILP::InsertOperandUsage(Value *op, struct twoValues IssueCycle, bool isNewI
     newInstruction.lastUsage = IssueCycle.value1;
     newInstruction.lastUsageInOrder = IssueCycle.value2;
 
+    if (flags & ANALYZE_ILP_CRITICAL_PATH) {
+        if (isNewInstruction)
+            updateCriticalPath(cast<Instruction>(op), IssueCycle.value1, Address);
+        else if (previousOpForCount != NULL)
+            CriticalPathOperands[op] = LookupCriticalPath(previousOpForCount);
+    }
+
     // fprintf(stderr,"thread %d adding %p at cyle %llu in structure %p\n", omp_get_thread_num(), op, IssueCycle, &LastUsageOperands);
     // LastUsageOperands.insert(pair<Value*,valueStarIndex>(op, newInstruction)); 
     LastUsageOperands[op] = newInstruction;
 }
 
+std::shared_ptr<CriticalPathNode> ILP::LookupCriticalPath(Value *op) {
+    map<Value*, std::shared_ptr<CriticalPathNode>>::iterator it = CriticalPathOperands.find(op);
+    if (it != CriticalPathOperands.end())
+        return it->second;
+    return std::shared_ptr<CriticalPathNode>();
+}
+
+// Slot of the table holding the memory chains of Address, emptied if it
+// belonged to another address
+CriticalPathMemory &ILP::LookupCriticalPathMemory(void *Address) {
+    unsigned long long index = ((unsigned long long)Address * 0x9E3779B97F4A7C15ULL) >> 32;
+    CriticalPathMemory &mem = CriticalPathAddresses[index % CRITICAL_PATH_MEMORY_ENTRIES];
+
+    if (mem.address != Address) {
+        mem = CriticalPathMemory();
+        mem.address = Address;
+    }
+
+    return mem;
+}
+
+// Finds the dependence that sets the issue cycle of I and extends its chain.
+// Consecutive instructions of the same function share the same segment, so the
+// chain only grows when the critical path crosses a function boundary.
+void ILP::updateCriticalPath(Instruction *I, unsigned long long cycle, void *Address) {
+    CriticalPathMemory *mem = NULL;
+    std::shared_ptr<CriticalPathNode> pred;
+    unsigned long long predStart = 0;
+    unsigned OpCode = I->getOpcode();
+
+    for (unsigned i = 0; i < I->getNumOperands(); i++) {
+        Value *v = I->getOperand(i);
+        if (valueIsConstantLike(v) && !isa<PHINode>(*v))
+            continue;
+        if (OpCode == Instruction::Call && isa<Function>(v))
+            continue;
+
+        // Results of phi instructions do not add a cycle (see getInstIssueCycle)
+        unsigned long long ready = LookupOperand(v).value1 + (isa<PHINode>(*v) ? 0 : 1);
+        if (ready >= cycle && (!pred || ready > predStart)) {
+            pred = LookupCriticalPath(v);
+            predStart = ready;
+        }
+    }
+
+    if (OpCode == Instruction::Load || OpCode == Instruction::Store) {
+        mem = &LookupCriticalPathMemory(Address);
+
+        if (mem->store && mem->storeCycle + 1 >= cycle) {
+            pred = mem->store;
+            predStart = mem->storeCycle + 1;
+        } else if (OpCode == Instruction::Store && mem->load && mem->loadCycle + 1 >= cycle) {
+            pred = mem->load;
+            predStart = mem->loadCycle + 1;
+        }
+    }
+
+    Function *F = I->getParent()->getParent();
+    std::shared_ptr<CriticalPathNode> node;
+
+    if (pred && pred->function == F) {
+        node = pred;
+    } else {
+        node = std::make_shared<CriticalPathNode>();
+        node->function = F;
+        node->start = pred ? min(predStart, cycle) : cycle;
+        node->depth = 0;
+
+        if (pred && pred->depth + 1 < CRITICAL_PATH_MAX_DEPTH) {
+            node->parent = pred;
+            node->depth = pred->depth + 1;
+        } else if (pred) {
+            // Chain too long: fold the ancestors into per-function totals
+            node->prefix = std::make_shared<map<Function *, unsigned long long>>();
+            foldCriticalPath(pred, node->start, *node->prefix);
+        }
+    }
+
+    CriticalPathOperands[I] = node;
+
+    if (OpCode == Instruction::Load) {
+        if (!mem->load || cycle >= mem->loadCycle) {
+            mem->load = node;
+            mem->loadCycle = cycle;
+        }
+    } else if (OpCode == Instruction::Store) {
+        mem->store = node;
+        mem->storeCycle = cycle;
+    }
+}
+
+// Accumulates the cycles spent in each function by the chain ending at 'end'
+void ILP::foldCriticalPath(std::shared_ptr<CriticalPathNode> node, unsigned long long end,
+                           map<Function *, unsigned long long> &cycles) {
+    while (node) {
+        cycles[node->function] += end - node->start;
+        end = node->start;
+
+        if (!node->parent) {
+            if (node->prefix) {
+                map<Function *, unsigned long long>::iterator it;
+                for (it = node->prefix->begin(); it != node->prefix->end(); it++)
+                    cycles[it->first] += it->second;
+            } else {
+                cycles[NULL] += end;
+            }
+        }
+
+        node = node->parent;
+    }
+}
+
+void ILP::JSONdumpCriticalPath(JSONmanager *JSONwriter) {
+    map<Function *, unsigned long long> cycles;
+    map<Function *, unsigned long long>::iterator it;
+    multimap<unsigned long long, Function *, greater<unsigned long long>> sorted;
+    multimap<unsigned long long, Function *, greater<unsigned long long>>::iterator sit;
+
+    if (CriticalPathHead)
+        foldCriticalPath(CriticalPathHead, MaxIssueCycle + 1, cycles);
+
+    for (it = cycles.begin(); it != cycles.end(); it++)
+        if (it->first && it->second)
+            sorted.insert(pair<unsigned long long, Function *>(it->second, it->first));
+
+    JSONwriter->String("critical_path");
+    JSONwriter->StartObject();
+
+        JSONwriter->String("unattributed_cycles");
+        JSONwriter->Uint64(cycles[NULL]);
+
+        JSONwriter->String("functions");
+        JSONwriter->StartArray();
+        for (sit = sorted.begin(); sit != sorted.end(); sit++) {
+            JSONwriter->StartObject();
+            JSONwriter->String("name");
+            JSONwriter->String(sit->second->getName().str().c_str());
+            JSONwriter->String("cycles");
+            JSONwriter->Uint64(sit->first);
+            JSONwriter->EndObject();
+        }
+        JSONwriter->EndArray();
+
+    JSONwriter->EndObject();
+}
+
 bool ILP::valueIsConstantLike(const Value* v) const {
     return (dyn_cast<Constant>(v) || dyn_cast<BasicBlock>(v) || isa<PHINode>(*v));
 }
@@ -385,7 +645,6 @@ bool ILP::valueIsFunctionCall(const Value* v) const {
 //#include <typeinfo>
 struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCycle) {
     unsigned long long OpCode = I.getOpcode();
-    raw_os_ostream myCout(cerr);
 
     map <Value*, unsigned long long>::iterator it;
     map <void *, struct MemoryDep>::iterator itMemory;
@@ -422,7 +681,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
         Function *F = get_calledFunction(CI);
 
 #ifdef TRACE_DEPENDENCIES
-        I.print(myCout);
+        I.print(errs());
         cerr << " : ";
 #endif
 
@@ -491,7 +750,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
         int NumOperands = I.getNumOperands();
 
 #ifdef TRACE_DEPENDENCIES
-        I.print(myCout);
+        I.print(errs());
         cerr << " : ";
 #endif
 
@@ -532,7 +791,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
     } else if (OpCode == Instruction::Load) {
 
 #ifdef TRACE_DEPENDENCIES
-        I.print(myCout);
+        I.print(errs());
         cerr << " : ";
 #endif
 
@@ -558,7 +817,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
             IssueCycle.value2 = max(IssueCycle.value2, maxStoreCycleInOrder+1);
             IssueCycle.value2 = max(IssueCycle.value2, MaxIssueCycleInOrder);
             
-            InsertOperandUsage(&I, IssueCycle, true);
+            InsertOperandUsage(&I, IssueCycle, true, NULL, Address);
             // LastUsageMemory.erase(itMemory);
             maxLoadCycle = max(maxLoadCycle, IssueCycle.value1);
             maxLoadCycleInOrder = max(maxLoadCycleInOrder, IssueCycle.value2);
@@ -586,7 +845,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
             // however it still happens in the LLVM IR code. for instance, 
             // when memory is initialized by a library call (e.g. memset)
             // or for global variables: global int32* optarg; %a = load i32** @optarg
-            InsertOperandUsage(&I, IssueCycle, true);
+            InsertOperandUsage(&I, IssueCycle, true, NULL, Address);
 
             // TODO: check how many times this happens
             struct MemoryDep tmp;
@@ -608,7 +867,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
     } else if (OpCode == Instruction::Store) {
 
 #ifdef TRACE_DEPENDENCIES
-        I.print(myCout);
+        I.print(errs());
         cerr << " : ";
 #endif
 
@@ -649,7 +908,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
             IssueCycle.value2 = max(IssueCycle.value2, maxLoadCycleInOrder+1);
             maxStoreCycleInOrder = max(maxStoreCycleInOrder, IssueCycle.value2);
             
-            InsertOperandUsage(&I, IssueCycle, true);
+            InsertOperandUsage(&I, IssueCycle, true, NULL, Address);
             InsertOperandUsage(I.getOperand(1), IssueCycle, false, &I);
 
             struct MemoryDep tmp;
@@ -667,7 +926,7 @@ struct twoValues ILP::getInstIssueCycle(Instruction &I, struct twoValues IssueCy
             itMemory->second = tmp;
 
         } else {
-            InsertOperandUsage(&I, IssueCycle, true);
+            InsertOperandUsage(&I, IssueCycle, true, NULL, Address);
             InsertOperandUsage(I.getOperand(1), IssueCycle, false, &I);
 
             struct MemoryDep tmp;
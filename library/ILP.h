@@ -26,6 +26,13 @@ class ILP;
 
 #define PRINT_FLOAT_PRECISION 3
 
+// Maximum number of function segments kept in a critical path chain
+// (ANALYZE_ILP_CRITICAL_PATH). Older segments are folded into per-function totals.
+#define CRITICAL_PATH_MAX_DEPTH 256
+// Entries of the direct-mapped table holding the chains of the last load and
+// store of each address. A colliding address evicts the previous one.
+#define CRITICAL_PATH_MEMORY_ENTRIES 65536
+
 struct valueStarIndex {
     unsigned long long lastUsage;
     unsigned long long lastUsageInOrder;
@@ -46,6 +53,27 @@ struct MemoryDep {
     unsigned long long lastLoadIndex;
 };
 
+// Segment of a dependence chain executed inside a single function.
+// The segment starts at cycle 'start' and ends where the next segment of the
+// chain starts. Segments are shared between all the values depending on them.
+struct CriticalPathNode {
+    Function *function;
+    unsigned long long start;
+    unsigned depth;
+    std::shared_ptr<CriticalPathNode> parent;
+    // Cycles per function of the folded ancestors (NULL stands for the cycles
+    // not explained by any dependence, e.g. imposed by the scheduler window)
+    std::shared_ptr<map<Function *, unsigned long long>> prefix;
+};
+
+struct CriticalPathMemory {
+    void *address;
+    std::shared_ptr<CriticalPathNode> store;
+    unsigned long long storeCycle;
+    std::shared_ptr<CriticalPathNode> load;
+    unsigned long long loadCycle;
+};
+
 class ILP: public InstructionAnalysis {
 
 public:
@@ -97,6 +125,12 @@ private:
     vector<unsigned long long>  ctrl_distribution;
     vector<unsigned long long>  non_ctrl_distribution;
 
+    // Control (value1) and non-control (value2) instructions issued in each
+    // cycle not folded into the histograms yet, i.e. from window_cycle on
+    map<unsigned long long, struct twoValues> IssuedPerCycle;
+    // First cycle not folded into the histograms yet
+    unsigned long long distribution_base_cycle;
+
     BasicBlock *prevBB;
     char compute;
 
@@ -104,6 +138,7 @@ private:
     map<Value*, valueStarIndex> LastUsageOperands;
     map<void *, MemoryDep>  LastUsageMemory;
 
+    // Histograms of instructions issued per cycle: number of cycles for each issue count.
     // Vector that stores the CDF distribution (aggregated over control and non-control)
     map<unsigned long long, unsigned long long> CDF;
     // Vector that stores the CDF distribution (for the ilp-type non-ctrl instructions only)
@@ -111,12 +146,29 @@ private:
     // Vector that stores the CDF distribution (for the ilp-type ctrl instructions only)
     map<unsigned long long, unsigned long long> CDF_ctrl;
 
+    // Critical path tracking: chain segment of each value and memory address,
+    // and the chain of the instruction that set MaxIssueCycle
+    map<Value*, std::shared_ptr<CriticalPathNode>> CriticalPathOperands;
+    vector<CriticalPathMemory> CriticalPathAddresses;
+    std::shared_ptr<CriticalPathNode> CriticalPathHead;
+
     struct twoValues LookupOperand(Value *op);
     unsigned long long LookupValueStarIndex(Value *op);
 
-    void InsertOperandUsage(Value *op, struct twoValues IssueCycle, bool isNewInstruction, Value* previous=NULL);
+    void InsertOperandUsage(Value *op, struct twoValues IssueCycle, bool isNewInstruction, Value* previous=NULL, void *Address=NULL);
     struct twoValues getInstIssueCycle(Instruction &I, struct twoValues IssueCycle);
 
+    void updateDistribution(unsigned long long cycle, bool isCtrl);
+    void foldDistribution(unsigned long long cycle);
+    void JSONdumpDistribution(JSONmanager *JSONwriter, map<unsigned long long, unsigned long long> &distribution);
+
+    std::shared_ptr<CriticalPathNode> LookupCriticalPath(Value *op);
+    void updateCriticalPath(Instruction *I, unsigned long long cycle, void *Address);
+    CriticalPathMemory &LookupCriticalPathMemory(void *Address);
+    void foldCriticalPath(std::shared_ptr<CriticalPathNode> node, unsigned long long end,
+                          map<Function *, unsigned long long> &cycles);
+    void JSONdumpCriticalPath(JSONmanager *JSONwriter);
+
 private:
     bool valueIsConstantLike(const Value* v) const;
     bool valueIsFunctionCall(const Value* v) const;
@@ -126,7 +178,10 @@ public:
         int window_size, int debug_flag, pthread_mutex_t *output_lock);
 
     void visit(Instruction &I);
+    void visit(Instruction &I, int InstType);
     void JSONdump(JSONmanager *JSONwriter, InstructionMix *mix);
+    unsigned long long getSpan();
+    unsigned long long getSpanInOrder();
     void updateILPforCall(Value *returnInstruction, Value *callInstruction);
     void updateILPIssueCycle(int type, Value *I, void *real_addr, unsigned long long issue_cycle);
 };
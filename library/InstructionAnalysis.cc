@@ -107,8 +107,10 @@ int InstructionAnalysis::getInstType(Instruction &I) {
 }
 
 bool InstructionAnalysis::isOfIntegerType(Instruction &I) {
-    int OpCode = getInstType(I);
+    return isOfIntegerType(getInstType(I));
+}
 
+bool InstructionAnalysis::isOfIntegerType(int OpCode) {
     switch (OpCode) { 
         // Conversion instructions
         case CONV_TYPE: return true;
@@ -136,8 +138,10 @@ bool InstructionAnalysis::isOfIntegerType(Instruction &I) {
 }
 
 bool InstructionAnalysis::isOfControlType(Instruction &I) {
-    int OpCode = getInstType(I);
+    return isOfControlType(getInstType(I));
+}
 
+bool InstructionAnalysis::isOfControlType(int OpCode) {
     switch (OpCode) {
         // Control instructions
         case CTRL_TYPE: return true;
@@ -146,8 +150,10 @@ bool InstructionAnalysis::isOfControlType(Instruction &I) {
 }
 
 bool InstructionAnalysis::isOfFloatingPointType(Instruction &I) {
-    int OpCode = getInstType(I);
+    return isOfFloatingPointType(getInstType(I));
+}
 
+bool InstructionAnalysis::isOfFloatingPointType(int OpCode) {
     switch (OpCode) {
         // Floating-point arithmetic instructions
         case FP_ADD_TYPE:         return true;
@@ -164,18 +170,25 @@ bool InstructionAnalysis::isOfFloatingPointType(Instruction &I) {
 }
 
 bool InstructionAnalysis::isOfMemoryType(Instruction &I) {
-    int OpType = getInstType(I);
     unsigned long long OpCode = I.getOpcode();
 
-    // Atomic memory instructions
+    switch (OpCode) {
+        // Load and store instructions
+        case Instruction::Load: return true;
+        case Instruction::Store:return true;
+
+        // Atomic memory instructions
+        case Instruction::AtomicCmpXchg: return true;
+        case Instruction::AtomicRMW:     return true;
+        default: return false;
+    }
+}
+
+// Loads and stores are classified by getMemoryInstType
+bool InstructionAnalysis::isOfMemoryType(int OpType) {
     if (OpType == ATOMIC_MEM_TYPE) return true;
 
-        switch (OpCode) {
-            // Load and store instructions
-            case Instruction::Load: return true;
-            case Instruction::Store:return true;
-            default: return false;
-        }
+    return OpType >= LD_FP_16BITS_TYPE && OpType <= MISC_MEM_TYPE;
 }
 
 int InstructionAnalysis::getMemoryInstType (Instruction &I) {
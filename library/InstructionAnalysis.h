@@ -99,6 +99,12 @@ public:
     bool isOfMemoryType(Instruction &I);
     bool isOfFloatingPointType(Instruction &I);
     bool isOfControlType(Instruction &I);
+
+    // Same tests on a type already returned by getInstType
+    static bool isOfIntegerType(int InstType);
+    static bool isOfMemoryType(int InstType);
+    static bool isOfFloatingPointType(int InstType);
+    static bool isOfControlType(int InstType);
     int getMemoryInstType (Instruction &I);
     unsigned getMemoryAccessSize(Instruction &I);
 };
@@ -47,6 +47,25 @@ InstructionMix::InstructionMix(Module *M, int thread_id, int processor_id) :
     NumMiscTyStoreInst      = 0;
 
     NumTotalInsts           = 0;
+    weight                  = 1;
+
+    std::fill(counters, counters + MIX_COUNTERS, 0);
+}
+
+unsigned long long InstructionMix::getCounter(unsigned opcode, int scalar_type, unsigned vector_size, unsigned type_id) {
+    unsigned width_slot = mixWidthSlot(scalar_type, vector_size);
+
+    if (width_slot != MIX_WIDTH_OTHER)
+        return counters[mixCounterIndex(opcode, width_slot, mixTypeSlot(type_id))];
+
+    const auto it = wide_counters.find(opcode);
+    if (it == wide_counters.end())
+        return 0;
+    const auto it_size = it->second.find(vector_size);
+    if (it_size == it->second.end())
+        return 0;
+    const auto it_type = it_size->second.find(mixTypeSlot(type_id));
+    return it_type == it_size->second.end() ? 0 : it_type->second;
 }
 
 // CONTROL instructions
@@ -456,24 +475,6 @@ void InstructionMix::JSONdump(JSONmanager *JSONwriter) {
     JSONwriter->EndObject();
 }
 
-std::ostream& operator<<(std::ostream& out, const map<unsigned, map<int, map<int, map<unsigned, unsigned long long> > > >& m) {
-    for (const auto& kv1:m) {
-       for (const auto& kv2:kv1.second) {
-           for (const auto& kv3:kv2.second) {
-               for (const auto& kv4:kv3.second) {
-                   out << kv1.first
-                       << "," << kv2.first
-                       << "," << kv3.first
-                       << "," << kv4.first
-                       << "," << kv4.second
-                       << endl;
-               }
-           }
-       }
-    }
-    return out;
-}
-
 void InstructionMix::JSONdump_partial(JSONmanager *JSONwriter, 
                                       unsigned inst_type,
                                       int scalar_type, 
@@ -483,63 +484,63 @@ void InstructionMix::JSONdump_partial(JSONmanager *JSONwriter,
 
     if (isFloat == 1 || isFloat == 2) {
         JSONwriter->String("float_16bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::HalfTyID]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::HalfTyID];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::HalfTyID));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::HalfTyID);
         JSONwriter->String("float_32bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::FloatTyID]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::FloatTyID];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::FloatTyID));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::FloatTyID);
         JSONwriter->String("float_64bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::DoubleTyID]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::DoubleTyID];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::DoubleTyID));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::DoubleTyID);
         JSONwriter->String("float_80bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::X86_FP80TyID]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::X86_FP80TyID];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::X86_FP80TyID));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::X86_FP80TyID);
         JSONwriter->String("float_128bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::FP128TyID]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::FP128TyID];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::FP128TyID));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::FP128TyID);
         JSONwriter->String("float_128bits_powerpc");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::PPC_FP128TyID]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::PPC_FP128TyID];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::PPC_FP128TyID));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::PPC_FP128TyID);
         JSONwriter->String("float_64bits_mmx");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::X86_MMXTyID]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::X86_MMXTyID];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::X86_MMXTyID));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::X86_MMXTyID);
     }
 
     if (isFloat == 0 || isFloat == 2) {
         JSONwriter->String("int_4bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][INT_4BITS]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][INT_4BITS];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, INT_4BITS));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, INT_4BITS);
         JSONwriter->String("int_8bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][INT_8BITS]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][INT_8BITS];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, INT_8BITS));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, INT_8BITS);
         JSONwriter->String("int_16bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][INT_16BITS]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][INT_16BITS];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, INT_16BITS));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, INT_16BITS);
         JSONwriter->String("int_32bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][INT_32BITS]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][INT_32BITS];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, INT_32BITS));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, INT_32BITS);
         JSONwriter->String("int_64bits");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][INT_64BITS]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][INT_64BITS];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, INT_64BITS));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, INT_64BITS);
         JSONwriter->String("int_misc");
-        JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][INT_MISCBITS]);
-        (*sum_partial) += counters[inst_type][scalar_type][vector_size][INT_MISCBITS];
+        JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, INT_MISCBITS));
+        (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, INT_MISCBITS);
 
         /* TODO */
         // JSONwriter->String("misc");
-        // JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][INT_MISCBITS]);
-        // (*sum_partial) += counters[inst_type][scalar_type][vector_size][INT_MISCBITS];
+        // JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, INT_MISCBITS));
+        // (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, INT_MISCBITS);
     }
     
     JSONwriter->String("struct_type");
-    JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::StructTyID]);
-    (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::StructTyID];
+    JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::StructTyID));
+    (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::StructTyID);
     JSONwriter->String("array_type");
-    JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::ArrayTyID]);
-    (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::ArrayTyID];
+    JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::ArrayTyID));
+    (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::ArrayTyID);
     JSONwriter->String("pointer_type");
-    JSONwriter->Uint64(counters[inst_type][scalar_type][vector_size][Type::PointerTyID]);
-    (*sum_partial) += counters[inst_type][scalar_type][vector_size][Type::PointerTyID];
+    JSONwriter->Uint64(getCounter(inst_type, scalar_type, vector_size, Type::PointerTyID));
+    (*sum_partial) += getCounter(inst_type, scalar_type, vector_size, Type::PointerTyID);
 
     return;
 }
@@ -575,11 +576,21 @@ void InstructionMix::JSONdump_perType(JSONmanager *JSONwriter,
             JSONwriter->Uint64(scalarInst);
             JSONwriter->EndObject();
 
-            for(auto kv1:counters[inst_type_LLVM][TY_VECTOR]) {
+            // Vector sizes with at least one instruction, in increasing order
+            vector<unsigned> vectorSizes;
+            for (unsigned log2 = 0; log2 <= MIX_MAX_VECTOR_LOG2; log2++) {
+                const unsigned long long *row = &counters[mixCounterIndex(inst_type_LLVM, MIX_WIDTH_VECTOR + log2, 0)];
+                if (std::any_of(row, row + MIX_TYPE_SLOTS, [](unsigned long long c) { return c != 0; }))
+                    vectorSizes.push_back(1 << log2);
+            }
+            for (const auto& kv1:wide_counters[inst_type_LLVM])
+                vectorSizes.push_back(kv1.first);
+            std::sort(vectorSizes.begin(), vectorSizes.end());
+
+            for(auto vectorSize:vectorSizes) {
                 JSONwriter->StartObject();
                     unsigned long long sum_partial = 0;
                     JSONwriter->String("vector_size");
-                    int vectorSize = kv1.first;
                     JSONwriter->Uint64(vectorSize);
                     JSONdump_partial(JSONwriter, inst_type_LLVM, TY_VECTOR, vectorSize, &sum_partial, isFloat);
                     JSONwriter->String("instructions");
@@ -594,7 +605,7 @@ void InstructionMix::JSONdump_perType(JSONmanager *JSONwriter,
     JSONwriter->String(vectorHeader.str().c_str());
     JSONwriter->Uint64(vectorInst);
     JSONwriter->String(miscHeader.str().c_str());
-    JSONwriter->Uint64(counters[inst_type_LLVM][TY_MISC][VECTOR_SIZE_MISC][0]);
+    JSONwriter->Uint64(getCounter(inst_type_LLVM, TY_MISC, VECTOR_SIZE_MISC, 0));
 
     JSONwriter -> EndObject();
     JSONwriter -> EndArray();
@@ -832,7 +843,6 @@ void InstructionMix::visitMemoryInstruction(Instruction &I) {
     unsigned long long OpCode = I.getOpcode();
     IntegerType *IntegerTy;
     VectorType *VectorTy;
-    raw_os_ostream myCout(cout);
 
     // Update memory accesses counters
     if (OpCode == Instruction::Load) {
@@ -849,58 +859,58 @@ void InstructionMix::visitMemoryInstruction(Instruction &I) {
 
                 // Scalar instructions
                 case Type::HalfTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumHalfTyLoadInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumHalfTyLoadInst += weight;
                     break;
                 case Type::FloatTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumFloatTyLoadInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumFloatTyLoadInst += weight;
                     break;
                 case Type::DoubleTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumDoubleTyLoadInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumDoubleTyLoadInst += weight;
                     break;
                 case Type::X86_FP80TyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumX86_FP80TyLoadInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumX86_FP80TyLoadInst += weight;
                     break;
                 case Type::FP128TyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumFP128TyLoadInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumFP128TyLoadInst += weight;
                     break;
                 case Type::PPC_FP128TyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumPPC_FP128TyLoadInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumPPC_FP128TyLoadInst += weight;
                     break;
                 case Type::X86_MMXTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumX86_MMXTyLoadInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumX86_MMXTyLoadInst += weight;
                     break;
                 case Type::IntegerTyID:
                     IntegerTy = dyn_cast<IntegerType>(PT->getElementType());
                     switch (IntegerTy->getBitWidth()) {
                         case 4:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_4BITS]++;
-                            Num4BitsLoadIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_4BITS) += weight;
+                            Num4BitsLoadIntInst += weight;
                             break;
                         case 8:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_8BITS]++;
-                            Num8BitsLoadIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_8BITS) += weight;
+                            Num8BitsLoadIntInst += weight;
                             break;
                         case 16:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_16BITS]++;
-                            Num16BitsLoadIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_16BITS) += weight;
+                            Num16BitsLoadIntInst += weight;
                             break;
                         case 32:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_32BITS]++;
-                            Num32BitsLoadIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_32BITS) += weight;
+                            Num32BitsLoadIntInst += weight;
                             break;
                         case 64:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_64BITS]++;
-                            Num64BitsLoadIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_64BITS) += weight;
+                            Num64BitsLoadIntInst += weight;
                             break;
                         default:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_MISCBITS]++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_MISCBITS) += weight;
                             break;
                     }
                     break;
@@ -914,60 +924,60 @@ void InstructionMix::visitMemoryInstruction(Instruction &I) {
                     // cout << " Opcode = " << OpCode << " Vector operand type =" << vectorOperandType << " Vector size = " << VectorTy->getNumElements() << endl;
 
                     if ( (vectorOperandType <= 6) || (vectorOperandType == 9) )
-                        counters[OpCode][TY_VECTOR][vectSize][vectorOperandType]++;
+                        counter(OpCode, TY_VECTOR, vectSize, vectorOperandType) += weight;
                     else if (vectorOperandType == Type::IntegerTyID) {
                         IntegerTy = dyn_cast<IntegerType>(VectorTy->getElementType());
                         switch (IntegerTy->getBitWidth()) {
                             case 4:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_4BITS]++;
-                                    Num4BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_4BITS) += weight;
+                                    Num4BitsLoadIntInst += weight;
                                     break;
                             case 8:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_8BITS]++;
-                                    Num8BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_8BITS) += weight;
+                                    Num8BitsLoadIntInst += weight;
                                     break;
                             case 16:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_16BITS]++;
-                                    Num16BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_16BITS) += weight;
+                                    Num16BitsLoadIntInst += weight;
                                     break;
                             case 32:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_32BITS]++;
-                                    Num32BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_32BITS) += weight;
+                                    Num32BitsLoadIntInst += weight;
                                     break;
                             case 64:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_64BITS]++;
-                                    Num64BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_64BITS) += weight;
+                                    Num64BitsLoadIntInst += weight;
                                     break;
                             default:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_MISCBITS]++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_MISCBITS) += weight;
                                     break;
                         }
                     } else {
-                        counters[OpCode][TY_VECTOR][vectSize][vectorOperandType]++;
+                        counter(OpCode, TY_VECTOR, vectSize, vectorOperandType) += weight;
                     }
                     break;
                 }
                 
                 // Scalar struct instructions
                 case Type::StructTyID: {
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
                     break;
                 }
                 // Scalar array instructions
                 case Type::ArrayTyID: {
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
                     break;
                 }
                 // Scalar pointer instructions
                 case Type::PointerTyID: {
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
                     break;
                 }
                 
 
                 default: {
-                    counters[OpCode][TY_MISC][VECTOR_SIZE_MISC][0]++;
-                    NumMiscTyLoadInst++;
+                    counter(OpCode, TY_MISC, VECTOR_SIZE_MISC, 0) += weight;
+                    NumMiscTyLoadInst += weight;
                     break;
                 }
             }
@@ -986,58 +996,58 @@ void InstructionMix::visitMemoryInstruction(Instruction &I) {
 
             switch (typeID) {
                 case Type::HalfTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumHalfTyStoreInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumHalfTyStoreInst += weight;
                     break;
                 case Type::FloatTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumFloatTyStoreInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumFloatTyStoreInst += weight;
                     break;
                 case Type::DoubleTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumDoubleTyStoreInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumDoubleTyStoreInst += weight;
                     break;
                 case Type::X86_FP80TyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumX86_FP80TyStoreInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumX86_FP80TyStoreInst += weight;
                     break;
                 case Type::FP128TyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumFP128TyStoreInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumFP128TyStoreInst += weight;
                     break;
                 case Type::PPC_FP128TyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumPPC_FP128TyStoreInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumPPC_FP128TyStoreInst += weight;
                     break;
                 case Type::X86_MMXTyID:
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
-                    NumX86_MMXTyStoreInst++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
+                    NumX86_MMXTyStoreInst += weight;
                     break;
                 case Type::IntegerTyID:
                     IntegerTy = dyn_cast<IntegerType>(PT->getElementType());
                     switch (IntegerTy->getBitWidth()) {
                         case 4:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_4BITS]++;
-                            Num4BitsStoreIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_4BITS) += weight;
+                            Num4BitsStoreIntInst += weight;
                             break;
                         case 8:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_8BITS]++;
-                            Num8BitsStoreIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_8BITS) += weight;
+                            Num8BitsStoreIntInst += weight;
                             break;
                         case 16:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_16BITS]++;
-                            Num16BitsStoreIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_16BITS) += weight;
+                            Num16BitsStoreIntInst += weight;
                             break;
                         case 32:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_32BITS]++;
-                            Num32BitsStoreIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_32BITS) += weight;
+                            Num32BitsStoreIntInst += weight;
                             break;
                         case 64:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_64BITS]++;
-                            Num64BitsStoreIntInst++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_64BITS) += weight;
+                            Num64BitsStoreIntInst += weight;
                             break;
                         default:
-                            counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_MISCBITS]++;
+                            counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_MISCBITS) += weight;
                             break;
                     }
                     break;
@@ -1051,72 +1061,96 @@ void InstructionMix::visitMemoryInstruction(Instruction &I) {
 
                     /* HalfTyID, FloatTyID, DoubleTyID, X86_FP80TyID, FP128TyID, PPC_FP128TyID, X86_MMXTyID */
                     if ((vectorOperandType <= 6) || (vectorOperandType == 9))
-                        counters[OpCode][TY_VECTOR][vectSize][vectorOperandType]++;
+                        counter(OpCode, TY_VECTOR, vectSize, vectorOperandType) += weight;
                     else if (vectorOperandType == Type::IntegerTyID) {
                         IntegerTy = dyn_cast<IntegerType>(VectorTy->getElementType());
                         switch (IntegerTy->getBitWidth()) {
                             case 4:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_4BITS]++;
-                                    Num4BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_4BITS) += weight;
+                                    Num4BitsLoadIntInst += weight;
                                     break;
                             case 8:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_8BITS]++;
-                                    Num8BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_8BITS) += weight;
+                                    Num8BitsLoadIntInst += weight;
                                     break;
                             case 16:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_16BITS]++;
-                                    Num16BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_16BITS) += weight;
+                                    Num16BitsLoadIntInst += weight;
                                     break;
                             case 32:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_32BITS]++;
-                                    Num32BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_32BITS) += weight;
+                                    Num32BitsLoadIntInst += weight;
                                     break;
                             case 64:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_64BITS]++;
-                                    Num64BitsLoadIntInst++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_64BITS) += weight;
+                                    Num64BitsLoadIntInst += weight;
                                     break;
                             default:
-                                    counters[OpCode][TY_VECTOR][vectSize][INT_MISCBITS]++;
+                                    counter(OpCode, TY_VECTOR, vectSize, INT_MISCBITS) += weight;
                                     break;
                         }
                     } else {
-                        counters[OpCode][TY_VECTOR][vectSize][vectorOperandType]++;
+                        counter(OpCode, TY_VECTOR, vectSize, vectorOperandType) += weight;
                     }
                     break;
                 }
 
                 // Scalar struct instructions
                 case Type::StructTyID: {
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
                     break;
                 }
                 // Scalar array instructions
                 case Type::ArrayTyID: {
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
                     break;
                 }
                 // Scalar pointer instructions
                 case Type::PointerTyID: {
-                    counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][typeID]++;
+                    counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, typeID) += weight;
                     break;
                 }                
                    
 
                 default:
-                    counters[OpCode][TY_MISC][VECTOR_SIZE_MISC][0]++;
-                    NumMiscTyStoreInst++;
+                    counter(OpCode, TY_MISC, VECTOR_SIZE_MISC, 0) += weight;
+                    NumMiscTyStoreInst += weight;
                     break;
             }
         }
     }
 }
 
-// Binary integer and floating-point and Bitwise instructions
-void InstructionMix::visitBinaryArithBitwiseCmpConvertSelectInstruction(Instruction &I) {
+// Accounts for 'executions' runs of a basic block at once, visiting the
+// instructions that WKLDchar::analyze would have seen (LLVM's debugging
+// calls are skipped, PHI nodes are not counted).
+void InstructionMix::visitStaticBasicBlock(BasicBlock &BB, unsigned long long executions) {
+    weight = executions;
+
+    for (BasicBlock::iterator I = BB.begin(), J = BB.end(); I != J; ++I) {
+        if (isa<PHINode>(*I))
+            continue;
+
+        if (CallInst *call = dyn_cast<CallInst>(I)) {
+            Function *_call = get_calledFunction(call);
+            if (_call && _call->getName().str().compare(0, 5, "llvm.") == 0)
+                continue;
+        }
+
+        visit(*I);
+        visitMemoryInstruction(*I);
+        visitBinaryArithBitwiseCmpConvertSelectInstruction(*I, getInstType(*I));
+    }
+
+    weight = 1;
+}
+
+// Binary integer and floating-point and Bitwise instructions.
+// InstType is the classification of I returned by getInstType.
+void InstructionMix::visitBinaryArithBitwiseCmpConvertSelectInstruction(Instruction &I, int InstType) {
     unsigned long long OpCode = I.getOpcode();
     IntegerType *IntegerTy;
     VectorType *VectorTy;
-    raw_os_ostream myCout(cout);
     Type* type;
 
     if  ( (OpCode == Instruction::Add)  || (OpCode == Instruction::Mul)  ||
@@ -1140,7 +1174,7 @@ void InstructionMix::visitBinaryArithBitwiseCmpConvertSelectInstruction(Instruct
         {
             type = I.getOperand(1)->getType();
         }
-    else if (getInstType(I) == CONV_TYPE)
+    else if (InstType == CONV_TYPE)
         {
             type = I.getType();
         }
@@ -1158,34 +1192,34 @@ void InstructionMix::visitBinaryArithBitwiseCmpConvertSelectInstruction(Instruct
                 VectorTy = dyn_cast<VectorType>(type);
                 unsigned vectorOperandType = VectorTy->getElementType()->getTypeID();
                 if ((vectorOperandType <= 6) || (vectorOperandType == 9))
-                    counters[OpCode][TY_VECTOR][VectorTy->getNumElements()][vectorOperandType]++;
+                    counter(OpCode, TY_VECTOR, VectorTy->getNumElements(), vectorOperandType) += weight;
                 else if (vectorOperandType == Type::IntegerTyID) {
                     IntegerTy = dyn_cast<IntegerType>(VectorTy->getElementType());
                     unsigned vectSize = VectorTy->getNumElements();
                     switch (IntegerTy->getBitWidth()) {
                         case 4:
-                                counters[OpCode][TY_VECTOR][vectSize][INT_4BITS]++;
+                                counter(OpCode, TY_VECTOR, vectSize, INT_4BITS) += weight;
                                 break;
                         case 8:
-                                counters[OpCode][TY_VECTOR][vectSize][INT_8BITS]++;
+                                counter(OpCode, TY_VECTOR, vectSize, INT_8BITS) += weight;
                                 break;
                         case 16:
-                                counters[OpCode][TY_VECTOR][vectSize][INT_16BITS]++;
+                                counter(OpCode, TY_VECTOR, vectSize, INT_16BITS) += weight;
                                 break;
                         case 32:
-                                counters[OpCode][TY_VECTOR][vectSize][INT_32BITS]++;
+                                counter(OpCode, TY_VECTOR, vectSize, INT_32BITS) += weight;
                                 break;
                         case 64:
-                                counters[OpCode][TY_VECTOR][vectSize][INT_64BITS]++;
+                                counter(OpCode, TY_VECTOR, vectSize, INT_64BITS) += weight;
                                 break;
                         default:
-                                counters[OpCode][TY_VECTOR][vectSize][INT_MISCBITS]++;
+                                counter(OpCode, TY_VECTOR, vectSize, INT_MISCBITS) += weight;
                                 break;
                     }
                 } else
-                    counters[OpCode][TY_VECTOR][VectorTy->getNumElements()][vectorOperandType]++;
+                    counter(OpCode, TY_VECTOR, VectorTy->getNumElements(), vectorOperandType) += weight;
             } else
-                counters[OpCode][TY_MISC][VECTOR_SIZE_MISC][0]++;
+                counter(OpCode, TY_MISC, VECTOR_SIZE_MISC, 0) += weight;
             return;
         }
     else if (OpCode == Instruction::ExtractElement ||  OpCode == Instruction::InsertElement ||
@@ -1207,75 +1241,75 @@ void InstructionMix::visitBinaryArithBitwiseCmpConvertSelectInstruction(Instruct
     // cout << " getTypeID=" << I.getOperand(1)->getType()->getTypeID();
 
     if (type->isVoidTy())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][0]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 0) += weight;
     else if (type->isHalfTy())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][1]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 1) += weight;
     else if (type->isFloatTy())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][2]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 2) += weight;
     else if (type->isDoubleTy())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][3]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 3) += weight;
     else if (type->isX86_FP80Ty())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][4]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 4) += weight;
     else if (type->isFP128Ty())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][5]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 5) += weight;
     else if (type->isPPC_FP128Ty())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][6]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 6) += weight;
     else if (type->isX86_MMXTy())
-        counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][9]++;
+        counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, 9) += weight;
     else if (type->isIntegerTy()) {
         IntegerTy = dyn_cast<IntegerType>(type);
         switch (IntegerTy->getBitWidth()) {
             case 4:
-                counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_4BITS]++;
+                counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_4BITS) += weight;
                 break;
             case 8:
-                counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_8BITS]++;
+                counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_8BITS) += weight;
                 break;
             case 16:
-                counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_16BITS]++;
+                counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_16BITS) += weight;
                 break;
             case 32:
-                counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_32BITS]++;
+                counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_32BITS) += weight;
                 break;
             case 64:
-                counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_64BITS]++;
+                counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_64BITS) += weight;
                 break;
             default:
-                counters[OpCode][TY_SCALAR][VECTOR_SIZE_SCALAR][INT_MISCBITS]++;
+                counter(OpCode, TY_SCALAR, VECTOR_SIZE_SCALAR, INT_MISCBITS) += weight;
                 break;
         }
     } else if (type->isVectorTy()) {
             VectorTy = dyn_cast<VectorType>(type);
             unsigned vectorOperandType = VectorTy->getElementType()->getTypeID();
             if ((vectorOperandType <= 6) || (vectorOperandType == 9))
-                counters[OpCode][TY_VECTOR][VectorTy->getNumElements()][vectorOperandType]++;
+                counter(OpCode, TY_VECTOR, VectorTy->getNumElements(), vectorOperandType) += weight;
             else if (vectorOperandType == Type::IntegerTyID) {
                 IntegerTy = dyn_cast<IntegerType>(VectorTy->getElementType());
                 unsigned vectSize = VectorTy->getNumElements();
                 switch (IntegerTy->getBitWidth()) {
                     case 4:
-                            counters[OpCode][TY_VECTOR][vectSize][INT_4BITS]++;
+                            counter(OpCode, TY_VECTOR, vectSize, INT_4BITS) += weight;
                             break;
                     case 8:
-                            counters[OpCode][TY_VECTOR][vectSize][INT_8BITS]++;
+                            counter(OpCode, TY_VECTOR, vectSize, INT_8BITS) += weight;
                             break;
                     case 16:
-                            counters[OpCode][TY_VECTOR][vectSize][INT_16BITS]++;
+                            counter(OpCode, TY_VECTOR, vectSize, INT_16BITS) += weight;
                             break;
                     case 32:
-                            counters[OpCode][TY_VECTOR][vectSize][INT_32BITS]++;
+                            counter(OpCode, TY_VECTOR, vectSize, INT_32BITS) += weight;
                             break;
                     case 64:
-                            counters[OpCode][TY_VECTOR][vectSize][INT_64BITS]++;
+                            counter(OpCode, TY_VECTOR, vectSize, INT_64BITS) += weight;
                             break;
                     default:
-                            counters[OpCode][TY_VECTOR][vectSize][INT_MISCBITS]++;
+                            counter(OpCode, TY_VECTOR, vectSize, INT_MISCBITS) += weight;
                             break;
                 }
             } else {
-                counters[OpCode][TY_VECTOR][VectorTy->getNumElements()][vectorOperandType]++;
+                counter(OpCode, TY_VECTOR, VectorTy->getNumElements(), vectorOperandType) += weight;
             }
         } else {
-            counters[OpCode][TY_MISC][VECTOR_SIZE_MISC][0]++;
+            counter(OpCode, TY_MISC, VECTOR_SIZE_MISC, 0) += weight;
         }
     }
@@ -20,12 +20,85 @@ class InstructionMix;
 #include "JSONmanager.h"
 #include <llvm/Support/raw_os_ostream.h>
 #include <sstream>
+#include <algorithm>
+
+// Layout of the flat instruction mix counters:
+// counters[opcode][width slot][type slot]
+#define MIX_OPCODES         Instruction::OtherOpsEnd
+
+// Width slots: scalar, misc, then vectors of 1, 2, 4, ..., 64 elements.
+// Other vector sizes are kept in a map (wide_counters).
+#define MIX_WIDTH_SCALAR    0
+#define MIX_WIDTH_MISC      1
+#define MIX_WIDTH_VECTOR    2
+#define MIX_MAX_VECTOR_LOG2 6
+#define MIX_WIDTH_SLOTS     (MIX_WIDTH_VECTOR + MIX_MAX_VECTOR_LOG2 + 1)
+#define MIX_WIDTH_OTHER     MIX_WIDTH_SLOTS
+
+// Type slots: the LLVM type IDs and the INT_* pseudo IDs used by the mix
+#define MIX_TYPE_VOID       0
+#define MIX_TYPE_HALF       1
+#define MIX_TYPE_FLOAT      2
+#define MIX_TYPE_DOUBLE     3
+#define MIX_TYPE_X86_FP80   4
+#define MIX_TYPE_FP128      5
+#define MIX_TYPE_PPC_FP128  6
+#define MIX_TYPE_X86_MMX    7
+#define MIX_TYPE_INT_4      8
+#define MIX_TYPE_INT_8      9
+#define MIX_TYPE_INT_16     10
+#define MIX_TYPE_INT_32     11
+#define MIX_TYPE_INT_64     12
+#define MIX_TYPE_INT_MISC   13
+#define MIX_TYPE_STRUCT     14
+#define MIX_TYPE_ARRAY      15
+#define MIX_TYPE_POINTER    16
+#define MIX_TYPE_OTHER      17
+#define MIX_TYPE_SLOTS      18
+
+#define MIX_COUNTERS        (MIX_OPCODES * MIX_WIDTH_SLOTS * MIX_TYPE_SLOTS)
+
+constexpr unsigned mixTypeSlot(unsigned type_id) {
+    return type_id == Type::VoidTyID      ? MIX_TYPE_VOID :
+           type_id == Type::HalfTyID      ? MIX_TYPE_HALF :
+           type_id == Type::FloatTyID     ? MIX_TYPE_FLOAT :
+           type_id == Type::DoubleTyID    ? MIX_TYPE_DOUBLE :
+           type_id == Type::X86_FP80TyID  ? MIX_TYPE_X86_FP80 :
+           type_id == Type::FP128TyID     ? MIX_TYPE_FP128 :
+           type_id == Type::PPC_FP128TyID ? MIX_TYPE_PPC_FP128 :
+           type_id == Type::X86_MMXTyID   ? MIX_TYPE_X86_MMX :
+           type_id == INT_4BITS           ? MIX_TYPE_INT_4 :
+           type_id == INT_8BITS           ? MIX_TYPE_INT_8 :
+           type_id == INT_16BITS          ? MIX_TYPE_INT_16 :
+           type_id == INT_32BITS          ? MIX_TYPE_INT_32 :
+           type_id == INT_64BITS          ? MIX_TYPE_INT_64 :
+           type_id == INT_MISCBITS        ? MIX_TYPE_INT_MISC :
+           type_id == Type::StructTyID    ? MIX_TYPE_STRUCT :
+           type_id == Type::ArrayTyID     ? MIX_TYPE_ARRAY :
+           type_id == Type::PointerTyID   ? MIX_TYPE_POINTER :
+                                            MIX_TYPE_OTHER;
+}
+
+constexpr unsigned mixLog2(unsigned v) {
+    return v <= 1 ? 0 : 1 + mixLog2(v >> 1);
+}
+
+constexpr unsigned mixWidthSlot(int scalar_type, unsigned vector_size) {
+    return scalar_type == TY_SCALAR ? MIX_WIDTH_SCALAR :
+           scalar_type == TY_MISC   ? MIX_WIDTH_MISC :
+           (vector_size && !(vector_size & (vector_size - 1)) && mixLog2(vector_size) <= MIX_MAX_VECTOR_LOG2) ?
+                MIX_WIDTH_VECTOR + mixLog2(vector_size) : MIX_WIDTH_OTHER;
+}
+
+constexpr unsigned mixCounterIndex(unsigned opcode, unsigned width_slot, unsigned type_slot) {
+    return (opcode * MIX_WIDTH_SLOTS + width_slot) * MIX_TYPE_SLOTS + type_slot;
+}
 
 class InstructionMix: public InstructionAnalysis, public InstVisitor<InstructionMix> {
     friend class InstVisitor<InstructionMix>;
 
     #define HANDLE_INST(N, OPCODE, CLASS) \
-    void visit##OPCODE(CLASS &) { ++Num##OPCODE##Inst;  ++NumTotalInsts;}
+    void visit##OPCODE(CLASS &) { Num##OPCODE##Inst += weight;  NumTotalInsts += weight;}
 
     #include "llvm/IR/Instruction.def"
 
@@ -34,11 +107,25 @@ class InstructionMix: public InstructionAnalysis, public InstVisitor<Instruction
         llvm_unreachable(0);
     }
 
+    // Counter of a given [InstructionType][ScalarType][VectorSize][OperandTypeID]
+    unsigned long long &counter(unsigned opcode, int scalar_type, unsigned vector_size, unsigned type_id) {
+        unsigned width_slot = mixWidthSlot(scalar_type, vector_size);
+        if (width_slot == MIX_WIDTH_OTHER)
+            return wide_counters[opcode][vector_size][mixTypeSlot(type_id)];
+        return counters[mixCounterIndex(opcode, width_slot, mixTypeSlot(type_id))];
+    }
+
+    unsigned long long getCounter(unsigned opcode, int scalar_type, unsigned vector_size, unsigned type_id);
+
+    // Number of executions accounted by each visit (1 unless expanding a static basic block)
+    unsigned long long weight;
+
 public:
     InstructionMix(Module *M, int thread_id, int processor_id);
 
     void visitMemoryInstruction(Instruction &I);
-    void visitBinaryArithBitwiseCmpConvertSelectInstruction(Instruction &I);
+    void visitBinaryArithBitwiseCmpConvertSelectInstruction(Instruction &I, int InstType);
+    void visitStaticBasicBlock(BasicBlock &BB, unsigned long long executions);
 
     #define HANDLE_INST(N, OPCODE, CLASS) \
     unsigned long long Num ## OPCODE ## Inst;
@@ -129,9 +216,11 @@ public:
 
     unsigned long long getNumTotalInsts();
     
-    // counters[InstructionType][ScalarType][VectorSize][OperandTypeID]
-    // E.g.: counters[Instruction::Load][0, 1, 2][0, 2 ...][Type::HalfTyID]
-    map<unsigned, map<int, map<int, map<unsigned, unsigned long long> > > > counters;
+    // Flat counters indexed by mixCounterIndex(opcode, width slot, type slot)
+    // E.g.: counter(Instruction::Load, TY_VECTOR, 4, Type::HalfTyID)
+    unsigned long long counters[MIX_COUNTERS];
+    // Vectors whose size has no width slot: wide_counters[opcode][vector size][type slot]
+    map<unsigned, map<unsigned, map<unsigned, unsigned long long> > > wide_counters;
 };
 
 #endif // LLVM_INSTRUCTION_MIX__H
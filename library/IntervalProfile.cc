@@ -0,0 +1,131 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/ 
+
+#include "IntervalProfile.h"
+#include <unistd.h>
+
+IntervalProfile::IntervalProfile(Module *M, 
+                                 int thread_id, 
+                                 int processor_id, 
+                                 unsigned long long interval_size, 
+                                 const string &filename) :
+    InstructionAnalysis(M, thread_id, processor_id), writer(buffer) {
+
+    this->interval_size = interval_size ? interval_size : 1;
+    this->next_sample = this->interval_size;
+    this->interval_id = 0;
+    this->prevSpan = 0;
+    this->prevSpanInOrder = 0;
+    for (int i = 0; i < INTERVAL_MIX_COUNT; i++)
+        this->prevMix[i] = 0;
+
+    string name = filename.empty() ? INTERVAL_DEFAULT_FILE : filename;
+    name += "." + std::to_string(getpid()) + "." + std::to_string(thread_id) + ".ndjson";
+
+    this->out = fopen(name.c_str(), "w");
+    if (!this->out) {
+        fprintf(stderr, "IntervalProfile: could not open %s, using stderr\n", name.c_str());
+        this->out = stderr;
+    }
+}
+
+IntervalProfile::~IntervalProfile() {
+    if (out && out != stderr)
+        fclose(out);
+}
+
+void IntervalProfile::sample(InstructionMix *mix, ILP *ilp, DataTempReuse *dtr) {
+    unsigned long long currentMix[INTERVAL_MIX_COUNT];
+    const char *mixNames[INTERVAL_MIX_COUNT] = {"instructions", "load", "store", "int", "fp", "ctrl"};
+
+    currentMix[INTERVAL_MIX_TOTAL] = mix->getNumTotalInsts();
+    currentMix[INTERVAL_MIX_LOAD] = mix->getNumLoadInst();
+    currentMix[INTERVAL_MIX_STORE] = mix->getNumStoreInst();
+    currentMix[INTERVAL_MIX_INT] = mix->getNumIntInst() + mix->getNumBitwiseInst() +
+                                   mix->getNumConversionInst() + mix->getNumICmpInst() +
+                                   mix->getNumAddrArithInst();
+    currentMix[INTERVAL_MIX_FP] = mix->getNumFPInst() + mix->getNumFCmpInst();
+    currentMix[INTERVAL_MIX_CTRL] = mix->getNumCtrlInst();
+
+    next_sample = currentMix[INTERVAL_MIX_TOTAL] + interval_size;
+
+    // Nothing executed since the last sample (e.g. final flush)
+    if (currentMix[INTERVAL_MIX_TOTAL] == prevMix[INTERVAL_MIX_TOTAL])
+        return;
+
+    buffer.Clear();
+    writer.Reset(buffer);
+
+    writer.StartObject();
+
+    writer.String("threadId");
+    writer.Uint64(thread_id);
+    writer.String("processId");
+    writer.Uint64(processor_id);
+    writer.String("interval");
+    writer.Uint64(interval_id);
+    writer.String("start");
+    writer.Uint64(prevMix[INTERVAL_MIX_TOTAL]);
+
+    writer.String("mix");
+    writer.StartObject();
+    for (int i = 0; i < INTERVAL_MIX_COUNT; i++) {
+        writer.String(mixNames[i]);
+        writer.Uint64(currentMix[i] - prevMix[i]);
+        prevMix[i] = currentMix[i];
+    }
+    writer.EndObject();
+
+    if (ilp) {
+        unsigned long long span = ilp->getSpan();
+        unsigned long long spanInOrder = ilp->getSpanInOrder();
+
+        writer.String("ilp");
+        writer.StartObject();
+        writer.String("span");
+        writer.Uint64(span - prevSpan);
+        writer.String("span_in_order");
+        writer.Uint64(spanInOrder - prevSpanInOrder);
+        writer.EndObject();
+
+        prevSpan = span;
+        prevSpanInOrder = spanInOrder;
+    }
+
+    if (dtr) {
+        dtr->flush();
+
+        // Only the bins that changed during the interval
+        map<unsigned long long, unsigned long long>::iterator it;
+        writer.String("dataReuse");
+        writer.StartArray();
+        for (it = dtr->DistanceDistributionMap.begin(); it != dtr->DistanceDistributionMap.end(); it++) {
+            unsigned long long &prev = prevDistanceDistribution[it->first];
+            if (it->second != prev) {
+                writer.StartArray();
+                writer.Uint64(it->first);
+                writer.Uint64(it->second - prev);
+                writer.EndArray();
+                prev = it->second;
+            }
+        }
+        writer.EndArray();
+    }
+
+    writer.EndObject();
+
+    fputs(buffer.GetString(), out);
+    fputc('\n', out);
+    fflush(out);
+
+    interval_id++;
+}
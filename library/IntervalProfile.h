@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/ 
+
+class IntervalProfile;
+
+#ifndef LLVM_INTERVAL_PROFILE__H
+#define LLVM_INTERVAL_PROFILE__H
+
+#include <stdio.h>
+
+#include "InstructionAnalysis.h"
+#include "InstructionMix.h"
+#include "DataTempReuse.h"
+#include "ILP.h"
+#include "utils.h"
+
+#define INTERVAL_DEFAULT_FILE "pisa-intervals"
+
+// Indexes of the instruction mix counters kept between two samples
+#define INTERVAL_MIX_TOTAL  0
+#define INTERVAL_MIX_LOAD   1
+#define INTERVAL_MIX_STORE  2
+#define INTERVAL_MIX_INT    3
+#define INTERVAL_MIX_FP     4
+#define INTERVAL_MIX_CTRL   5
+#define INTERVAL_MIX_COUNT  6
+
+// Streams the difference of the instruction mix, ILP and data reuse
+// counters every 'interval_size' instructions (one JSON record per line).
+// Each thread writes its own file: <filename>.<pid>.<thread_id>.ndjson
+class IntervalProfile: public InstructionAnalysis {
+    FILE *out;
+    unsigned long long interval_size;
+    unsigned long long interval_id;
+
+    // Counters at the end of the previous interval
+    unsigned long long prevMix[INTERVAL_MIX_COUNT];
+    unsigned long long prevSpan;
+    unsigned long long prevSpanInOrder;
+    map<unsigned long long, unsigned long long> prevDistanceDistribution;
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer;
+
+public:
+    // Instruction count at which the next sample is taken
+    unsigned long long next_sample;
+
+    IntervalProfile(Module *M, 
+                    int thread_id, 
+                    int processor_id, 
+                    unsigned long long interval_size, 
+                    const string &filename = "");
+    ~IntervalProfile();
+
+    void sample(InstructionMix *mix, ILP *ilp, DataTempReuse *dtr);
+};
+
+#endif // LLVM_INTERVAL_PROFILE__H
@@ -11,11 +11,15 @@
  *******************************************************************************/ 
 
 #include "JSONmanager.h"
+#include <assert.h>
+#include <limits.h>
 #include <unistd.h>
 
-JSONmanager::JSONmanager(int procId, unsigned long long options, vector<WKLDchar>*  WKLDcharForThreads){
-    JSONwriter = std::unique_ptr<rapidjson::PrettyWriter<rapidjson::StringBuffer>>(new rapidjson::PrettyWriter<rapidjson::StringBuffer>(JSONbuffer));
+// Forwards a call to the writer in use (master only)
+#define JSON_WRITE(call) \
+    do { if (JSONcompactWriter) JSONcompactWriter->call; else JSONwriter->call; } while (0)
 
+JSONmanager::JSONmanager(int procId, unsigned long long options, vector<WKLDchar>*  WKLDcharForThreads){
     PISAfp = NULL;
     AddJSONfp = NULL;
     
@@ -57,7 +61,14 @@ void JSONmanager::openMaster(char* PISAFileName, char* AddJSONData, char* AppNam
         }
     }
 
-    dump_JSON_header(JSONwriter.get(),AppName,TestName);// Prepare JSON header.
+    JSONstreamBuffer.reset(new char[JSON_STREAM_BUFFER_SIZE]);
+    JSONstream.reset(new rapidjson::FileWriteStream(PISAfp, JSONstreamBuffer.get(), JSON_STREAM_BUFFER_SIZE));
+    if (options & JSON_COMPACT)
+        JSONcompactWriter.reset(new rapidjson::Writer<rapidjson::FileWriteStream>(*JSONstream));
+    else
+        JSONwriter.reset(new rapidjson::PrettyWriter<rapidjson::FileWriteStream>(*JSONstream));
+
+    dump_JSON_header(AppName,TestName);// Prepare JSON header.
 }
 
 void JSONmanager::openSlave(int masterId){
@@ -66,12 +77,6 @@ void JSONmanager::openSlave(int masterId){
 }
 
 
-#define RECV_JSON_COMMAND() \
-    MPI_Recv(&jsonCommand, 1, MPI_INT, sourceId, 0, MPI_COMM_WORLD, &status);
-
-#define SEND_JSON_COMMAND(command) \
-    MPI_Ssend(&command, 1, MPI_INT, masterId, 0, MPI_COMM_WORLD); 
-
 #define DEBUG_JSON_COMM 0
 void JSONmanager::dump(int procId){
     if(this->procId == procId){
@@ -84,237 +89,208 @@ void JSONmanager::dump(int procId){
 
         compute_shared_memory((*WKLDcharForThreads), options, sharedBytes, sharedAccesses);
 
-        if(procId != masterId){
-            unsigned long long threads = WKLDcharForThreads->size();
-            #if DEBUG_JSON_COMM
-                fprintf(stderr,"JSONman: Slave considers %llu threads\n", threads);
-            #endif
-            MPI_Ssend(&threads, 1, MPI_UNSIGNED_LONG_LONG, masterId, 0, MPI_COMM_WORLD);// communicate the number of threads
-        }
-        
         for (unsigned long i = 0; i < WKLDcharForThreads->size(); i++) {
-          if (InitializedThreads[i]) {
-              (*WKLDcharForThreads)[i].JSONdump(this, sharedBytes, sharedAccesses);
-          }
+            if (InitializedThreads[i]) {
+                (*WKLDcharForThreads)[i].JSONdump(this, sharedBytes, sharedAccesses);
 
-            if(procId != masterId){
-                int command = JSON_END_THREAD;
-                SEND_JSON_COMMAND(command);// communicate the thread data terminated
+                if(procId != masterId)
+                    putCommand(JSON_END_THREAD);// the thread data terminated
+                else
+                    flush();
             }
         }
     }
-
-    else if(PISAfp != NULL){// This is the master
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master collecting JSON for %d\n",procId);
-        #endif
-
-        dumpFrom(procId);
-    }
 }
 
-void JSONmanager::dumpFrom(int sourceId){
-    MPI_Status status;
+// Collective: the slaves send their buffered threads to the master, which
+// writes them in rank order. The ranks are gathered in rounds of
+// consecutive ranks whose buffers fit JSON_GATHER_BUDGET (a larger rank
+// gets a round of its own), so MPI_Gatherv displacements stay within int
+// and the master holds at most one round at a time.
+void JSONmanager::gather(int procCount){
+    assert(JSONtokens.size() <= INT_MAX);
+
+    int size = JSONtokens.size();
+    vector<int> sizes(procCount, 0);
 
-    unsigned long long threads = 0;
-    MPI_Recv(&threads, 1, MPI_UNSIGNED_LONG_LONG, sourceId, 0, MPI_COMM_WORLD, &status);
-    #if DEBUG_JSON_COMM
-        fprintf(stderr,"JSONman: Master expects %llu threads\n", threads);
-    #endif
+    // Every rank needs all the sizes to follow the same rounds
+    MPI_Allgather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, MPI_COMM_WORLD);
 
+    vector<int> counts(procCount);
+    vector<int> offsets(procCount);
+    vector<char> tokens;
 
-    for (unsigned long i = 0; i < threads; i++) {
-        int jsonCommand;
+    int first = 0;
+    while(first < procCount){
+        unsigned long long total = sizes[first];
+        int last = first + 1;
+        while(last < procCount && total + sizes[last] <= JSON_GATHER_BUDGET)
+            total += sizes[last++];
 
-        RECV_JSON_COMMAND();
         #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master starts managing command %d\n", jsonCommand);
+            fprintf(stderr,"JSONman: process %d gathering ranks %d to %d (%llu bytes)\n",procId,first,last - 1,total);
         #endif
-        while(jsonCommand != JSON_END_THREAD){
 
-            switch(jsonCommand){
+        int position = 0;
+        for(int i = 0; i < procCount; i++){
+            counts[i] = (i >= first && i < last) ? sizes[i] : 0;
+            offsets[i] = position;
+            position += counts[i];
+        }
 
-                case JSON_START_ARRAY:
-                    StartArray();
-                break;
+        bool sending = procId >= first && procId < last;
+        if(procId == masterId)
+            tokens.resize(total + 1);
 
-                case JSON_END_ARRAY:
-                    EndArray();
-                break;
+        MPI_Gatherv((void*)JSONtokens.data(), sending ? size : 0, MPI_CHAR,
+                    tokens.data(), counts.data(), offsets.data(), MPI_CHAR, masterId, MPI_COMM_WORLD);
 
-                case JSON_START_OBJECT:
-                    StartObject();
-                break;
+        if(procId == masterId)
+            for(int i = first; i < last; i++)
+                if(i != masterId)
+                    replay(tokens.data() + offsets[i], sizes[i]);
 
-                case JSON_END_OBJECT:
-                    EndObject();
-                break;
+        first = last;
+    }
 
-                case JSON_ULL:
-                    unsigned long long ULLdatum;
-                MPI_Recv(&ULLdatum, 1, MPI_UNSIGNED_LONG_LONG, sourceId, 0, MPI_COMM_WORLD, &status);
-                    Uint64(ULLdatum);
-                break;
+    JSONtokens.clear();
+}
 
-                case JSON_STRING:
-                    char StringDatum[JSON_MAX_STRING_LENGTH];
-                    int recvLength, actLength;
+// Writes the threads buffered by a slave (master only)
+void JSONmanager::replay(const char *tokens, unsigned long long size){
+    const char *end = tokens + size;
 
-                    MPI_Recv(&recvLength, 1, MPI_INT, sourceId, 0 , MPI_COMM_WORLD, &status);
+    while(tokens < end){
+        int jsonCommand = *tokens++;
 
-                    #if DEBUG_JSON_COMM
-                        fprintf(stderr,"JSONman: Master expecting %d chars\n", recvLength);
-                    #endif
+        switch(jsonCommand){
+            case JSON_END_THREAD:
+                flush();
+            break;
 
-                MPI_Recv(StringDatum, recvLength, MPI_CHAR, sourceId, 0, MPI_COMM_WORLD, &status);
+            case JSON_START_ARRAY:
+                StartArray();
+            break;
 
-                    #if DEBUG_JSON_COMM
-                        fprintf(stderr,"JSONman: Master received: %s\n", StringDatum);
-                    #endif
-                    String(StringDatum);
-                break;
+            case JSON_END_ARRAY:
+                EndArray();
+            break;
 
-                case JSON_DOUBLE:
-                    double doubleDatum;
-                MPI_Recv(&doubleDatum, 1, MPI_DOUBLE, sourceId, 0, MPI_COMM_WORLD, &status);
-                    Double(doubleDatum);
-                break;
+            case JSON_START_OBJECT:
+                StartObject();
+            break;
 
-                default:
-                    fprintf(stderr,"JSONman: Error: unknown JSON command to be managed\n");
-                break;
+            case JSON_END_OBJECT:
+                EndObject();
+            break;
+
+            case JSON_ULL: {
+                unsigned long long ULLdatum;
+                memcpy(&ULLdatum, tokens, sizeof(ULLdatum));
+                tokens += sizeof(ULLdatum);
+                Uint64(ULLdatum);
             }
+            break;
+
+            case JSON_STRING: {
+                int length;
+                memcpy(&length, tokens, sizeof(length));
+                tokens += sizeof(length);
+                string StringDatum(tokens, length);
+                tokens += length;
+                String(StringDatum.c_str());
+            }
+            break;
+
+            case JSON_DOUBLE: {
+                double doubleDatum;
+                memcpy(&doubleDatum, tokens, sizeof(doubleDatum));
+                tokens += sizeof(doubleDatum);
+                Double(doubleDatum);
+            }
+            break;
 
-            RECV_JSON_COMMAND();
-            #if DEBUG_JSON_COMM
-                fprintf(stderr,"JSONman: Master starts managing command %d\n", jsonCommand);
-            #endif
+            default:
+                fprintf(stderr,"JSONman: Error: unknown JSON command to be managed\n");
+                return;
         }
-        // Received thread end command
     }
-    // Received all thread data for the process sourceId
 }
 
-void JSONmanager::StartArray(){
-    if(procId != masterId){
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Slave messaging for StartArray()\n");
-        #endif
-        int command = JSON_START_ARRAY;
-        SEND_JSON_COMMAND(command);
+void JSONmanager::putCommand(int command){
+    JSONtokens.push_back((char)command);
+}
 
-    } else{// masterThread
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master managing StartArray()\n");
-        #endif
-        JSONwriter -> StartArray();
-    }
+void JSONmanager::StartArray(){
+    if(procId != masterId)
+        putCommand(JSON_START_ARRAY);
+    else
+        JSON_WRITE(StartArray());
 }
 
 void JSONmanager::EndArray(){
-    if(procId != masterId){
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Slave messaging for EndArray()\n");
-        #endif
-        int command = JSON_END_ARRAY;
-        SEND_JSON_COMMAND(command);
-
-    } else{ // masterThread
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master managing EndArray()\n");
-        #endif
-        JSONwriter -> EndArray();
-    }
+    if(procId != masterId)
+        putCommand(JSON_END_ARRAY);
+    else
+        JSON_WRITE(EndArray());
 }
 
 void JSONmanager::StartObject(){
-    if(procId != masterId){
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Slave messaging for StartObject()\n");
-        #endif
-        int command = JSON_START_OBJECT;
-        SEND_JSON_COMMAND(command);
-
-    }else{// masterThread
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master managing StartObject()\n");
-        #endif
-        JSONwriter -> StartObject();
-    }
+    if(procId != masterId)
+        putCommand(JSON_START_OBJECT);
+    else
+        JSON_WRITE(StartObject());
 }
 
 void JSONmanager::EndObject(){
-    if(procId != masterId){
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Slave messaging for EndObject()\n");
-        #endif
-        int command = JSON_END_OBJECT;
-        SEND_JSON_COMMAND(command);
-
-    }else{// masterThread
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master managing EndObject()\n");
-        #endif
-        JSONwriter -> EndObject();
-    }
+    if(procId != masterId)
+        putCommand(JSON_END_OBJECT);
+    else
+        JSON_WRITE(EndObject());
 }
 
 void JSONmanager::Uint64(unsigned long long datum){
     if(procId != masterId){
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Slave messaging for Uint64(%llu)\n",datum);
-        #endif
-        int command = JSON_ULL;
-        SEND_JSON_COMMAND(command);
-        MPI_Ssend(&datum, 1, MPI_UNSIGNED_LONG_LONG, masterId, 0, MPI_COMM_WORLD);
-
-    }else{// masterThread
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master managing Uint64(%llu)\n",datum);
-        #endif
-        JSONwriter -> Uint64(datum);
-    }
+        putCommand(JSON_ULL);
+        JSONtokens.append((const char*)&datum, sizeof(datum));
+    }else
+        JSON_WRITE(Uint64(datum));
 }
 
 void JSONmanager::String(const char* datum){
     if(procId != masterId){
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Slave messaging for String(\"%s\")\n",datum);
-        #endif
-        int command = JSON_STRING;
-        int length = strlen(datum)+1;
-        SEND_JSON_COMMAND(command);
-        MPI_Ssend(&length, 1, MPI_INT, masterId, 0, MPI_COMM_WORLD);
-        MPI_Ssend(datum, strlen(datum)+1, MPI_CHAR, masterId, 0, MPI_COMM_WORLD);
-
-    }else{// masterThread
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master managing String(\"%s\")\n",datum);
-        #endif
-        JSONwriter -> String(datum);
-    }
+        int length = strlen(datum);
+        putCommand(JSON_STRING);
+        JSONtokens.append((const char*)&length, sizeof(length));
+        JSONtokens.append(datum, length);
+    }else
+        JSON_WRITE(String(datum));
 }
 
 void JSONmanager::Double(double datum){
     if(procId != masterId){
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Slave messaging for Double(%f)\n",datum);
-        #endif
-        int command = JSON_DOUBLE;
-        SEND_JSON_COMMAND(command);
-        MPI_Ssend(&datum, 1, MPI_DOUBLE, masterId, 0, MPI_COMM_WORLD);
+        putCommand(JSON_DOUBLE);
+        JSONtokens.append((const char*)&datum, sizeof(datum));
+    }else
+        JSON_WRITE(Double(datum));
+}
 
-    }else{// masterThread
-        #if DEBUG_JSON_COMM
-            fprintf(stderr,"JSONman: Master managing Double(%f)\n",datum);
-        #endif
-        JSONwriter -> Double(datum);
+// Only used by the master for the additional data
+void JSONmanager::Int(int datum){
+    JSON_WRITE(Int(datum));
+}
+
+// Writes out what the master streamed so far
+void JSONmanager::flush(){
+    if(JSONstream){
+        JSONstream->Flush();
+        fflush(PISAfp);
     }
 }
 
 void JSONmanager::close(){
     if(PISAfp != NULL){// The master needs to write the footer and closes the file.
-        dump_JSON_footer(JSONwriter.get(),&JSONbuffer,PISAfp);
+        dump_JSON_footer();
         if(PISAfp != stderr)
             fclose(PISAfp);
     }
@@ -349,8 +325,8 @@ string getCmdExe() {
 }
 
 
-void JSONmanager::dump_JSON_header(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter,char* AppName,char* TestName) {
-    JSONwriter->StartObject();
+void JSONmanager::dump_JSON_header(char* AppName,char* TestName) {
+    StartObject();
 
     bool hasApp,hasScenario,hasExecmd,hasTime;
     hasApp = false;
@@ -359,57 +335,57 @@ void JSONmanager::dump_JSON_header(rapidjson::PrettyWriter<rapidjson::StringBuff
     hasTime = false;
 
     // Dump additional data
-    dump_additional_data(JSONwriter,hasApp,hasScenario,hasExecmd,hasTime);
+    dump_additional_data(hasApp,hasScenario,hasExecmd,hasTime);
 
     // Dump the default values
     if(!hasApp){
-        JSONwriter->String("application");
-        JSONwriter->String(AppName);
+        String("application");
+        String(AppName);
     }
 
     if(!hasScenario){
-        JSONwriter->String("test-scenario");
-        JSONwriter->String(TestName);
+        String("test-scenario");
+        String(TestName);
     }
 
     if(!hasExecmd){
-        JSONwriter->String("execmd");
+        String("execmd");
         string cmdExe = getCmdExe();
-        JSONwriter->String(cmdExe.c_str());
+        String(cmdExe.c_str());
     }
 
     if(!hasTime){
         char currentTime[80];
-        JSONwriter->String("time");
+        String("time");
         currentDateTime(currentTime);
-        JSONwriter->String(currentTime);
+        String(currentTime);
     }
 
     // Dump the threads
-    JSONwriter->String("threads");
-    JSONwriter->StartArray();
+    String("threads");
+    StartArray();
 }
 
-void JSONmanager::dump_additional_object(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter, rapidjson::Value* obj){
+void JSONmanager::dump_additional_object(rapidjson::Value* obj){
     for (rapidjson::Value::ConstMemberIterator itr = obj->MemberBegin(); itr != obj->MemberEnd(); ++itr){
-        JSONwriter->String( itr->name.GetString() );
+        String( itr->name.GetString() );
     
         if(itr->value.IsInt()){
-            JSONwriter->Int(itr->value.GetInt());
+            Int(itr->value.GetInt());
         }
 
         if(itr->value.IsDouble()){
-            JSONwriter->Double(itr->value.GetDouble());
+            Double(itr->value.GetDouble());
         }
 
         if(itr->value.IsString()){
-            JSONwriter->String(itr->value.GetString());
+            String(itr->value.GetString());
         }
 
         if(itr->value.GetType() == rapidjson::kObjectType){
-            JSONwriter->StartObject();
-            dump_additional_object(JSONwriter, (rapidjson::Value*) &(itr->value));
-            JSONwriter->EndObject();
+            StartObject();
+            dump_additional_object((rapidjson::Value*) &(itr->value));
+            EndObject();
         }
 
         if(itr->value.GetType() == rapidjson::kArrayType)
@@ -417,8 +393,7 @@ void JSONmanager::dump_additional_object(rapidjson::PrettyWriter<rapidjson::Stri
     }
 }
 
-void JSONmanager::dump_additional_data(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter,
-                                       bool& hasApp, bool& hasScenario, bool& hasExecmd, bool& hasTime){
+void JSONmanager::dump_additional_data(bool& hasApp, bool& hasScenario, bool& hasExecmd, bool& hasTime){
 
     if(AddJSONfp != NULL){ // There is additional data to carry on!
         char readBuffer[65536];
@@ -435,20 +410,19 @@ void JSONmanager::dump_additional_data(rapidjson::PrettyWriter<rapidjson::String
         if(document.HasMember("time"))
             hasTime = true;
         
-        dump_additional_object(JSONwriter, &document);
+        dump_additional_object(&document);
     }
 }
 
-void JSONmanager::dump_JSON_footer(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter, 
-                                   rapidjson::StringBuffer* JSONbuffer, FILE* PISAfp) {
+void JSONmanager::dump_JSON_footer() {
 
     // end threads array
-    JSONwriter->EndArray();
+    EndArray();
   
     // end all JSON
-    JSONwriter->EndObject();
+    EndObject();
 
-    fprintf(PISAfp,"%s\n",JSONbuffer->GetString());
-    // JSONbuffer->Clear();
+    JSONstream->Put('\n');
+    flush();
 }
 
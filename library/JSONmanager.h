@@ -24,20 +24,32 @@ class JSONmanager;
 #define JSON_STRING 6
 #define JSON_DOUBLE 7
 
-#define JSON_MAX_STRING_LENGTH 128
+
+// Buffer of the stream writing the output file
+#define JSON_STREAM_BUFFER_SIZE 65536
+// Bytes of slave output gathered by the master in one round (at most INT_MAX)
+#define JSON_GATHER_BUDGET (64ULL << 20)
 
 #include "WKLDchar.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
 
 class JSONmanager{
-    rapidjson::StringBuffer JSONbuffer;
-    std::unique_ptr<rapidjson::PrettyWriter<rapidjson::StringBuffer>> JSONwriter;
+    // The master streams the document to PISAfp, flushing it after each
+    // thread. Only one of the two writers exists (JSON_COMPACT selects the
+    // non-indented one).
+    std::unique_ptr<char[]> JSONstreamBuffer;
+    std::unique_ptr<rapidjson::FileWriteStream> JSONstream;
+    std::unique_ptr<rapidjson::PrettyWriter<rapidjson::FileWriteStream>> JSONwriter;
+    std::unique_ptr<rapidjson::Writer<rapidjson::FileWriteStream>> JSONcompactWriter;
     FILE* PISAfp;
     FILE* AddJSONfp;
+    // Threads of a slave, encoded as JSON_* commands until gather()
+    string JSONtokens;
     unsigned long long options;
     vector<WKLDchar>*  WKLDcharForThreads;
     int procId, masterId;
@@ -47,12 +59,13 @@ public:
     void openMaster(char* PISAFileName, char* AddJSONData, char* AppName, char* TestName);
     void openSlave(int masterId); // FIXME: parameters masterId
     void dump(int sourceId);
+    void gather(int procCount);
     void close();
 
     /*
         The following functions are emulating the JSONwriter
         but either write directly to the JSONwriter (if master)
-        or forward the data to the master (if slave)
+        or buffer the data for the master (if slave)
     */
 
     void StartArray();
@@ -64,12 +77,14 @@ public:
     void Double(double);
     
     private:
-        void dumpFrom(int sourceId);
-        void dump_JSON_header(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter,char* AppName,char* TestName);
-        void dump_JSON_footer(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter, rapidjson::StringBuffer* JSONbuffer, FILE* PISAfp);
-        void dump_additional_data(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter,
-                                  bool& hasApp, bool& hasSenario, bool& hasExecmd, bool& hasTime);
-        void dump_additional_object(rapidjson::PrettyWriter<rapidjson::StringBuffer> *JSONwriter, rapidjson::Value* obj);
+        void Int(int);
+        void flush();
+        void replay(const char *tokens, unsigned long long size);
+        void putCommand(int command);
+        void dump_JSON_header(char* AppName,char* TestName);
+        void dump_JSON_footer();
+        void dump_additional_data(bool& hasApp, bool& hasSenario, bool& hasExecmd, bool& hasTime);
+        void dump_additional_object(rapidjson::Value* obj);
 };
 
 #endif
@@ -0,0 +1,182 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/
+
+#include "ShardedReuse.h"
+#include "DataTempReuse.h"
+
+struct ShardedReuseWorker {
+    ShardedReuse *owner;
+    unsigned shard;
+};
+
+ShardedReuse::ShardedReuse(unsigned shards) {
+    this->shards = shards;
+    this->LastAccess = vector<map<unsigned long long, unsigned long long>>(shards);
+    this->lines = vector<unsigned long long>(SHARDED_REUSE_BATCH);
+    this->previous = vector<unsigned long long>(SHARDED_REUSE_BATCH);
+    this->record = vector<bool>(SHARDED_REUSE_BATCH);
+    this->count = 0;
+    this->clock = 0;
+    this->base = 0;
+    this->capacity = SHARDED_REUSE_CAPACITY;
+    this->fenwick = vector<unsigned long long>(this->capacity + 1, 0);
+
+    pthread_mutex_init(&this->lock, NULL);
+    pthread_cond_init(&this->start, NULL);
+    pthread_cond_init(&this->done, NULL);
+    this->generation = 0;
+    this->pending = 0;
+    this->task = SHARDED_REUSE_LOOKUP;
+
+    this->workers = vector<pthread_t>(shards);
+    for (unsigned i = 0; i < shards; i++) {
+        struct ShardedReuseWorker *arg = new ShardedReuseWorker();
+        arg->owner = this;
+        arg->shard = i;
+        pthread_create(&this->workers[i], NULL, ShardedReuse::worker, arg);
+    }
+}
+
+ShardedReuse::~ShardedReuse() {
+    dispatch(SHARDED_REUSE_EXIT);
+
+    for (unsigned i = 0; i < shards; i++)
+        pthread_join(this->workers[i], NULL);
+
+    pthread_cond_destroy(&this->done);
+    pthread_cond_destroy(&this->start);
+    pthread_mutex_destroy(&this->lock);
+}
+
+void *ShardedReuse::worker(void *arg) {
+    ShardedReuse *owner = ((struct ShardedReuseWorker *)arg)->owner;
+    unsigned shard = ((struct ShardedReuseWorker *)arg)->shard;
+    unsigned long long seen = 0;
+    delete (struct ShardedReuseWorker *)arg;
+
+    while (1) {
+        pthread_mutex_lock(&owner->lock);
+        while (owner->generation == seen)
+            pthread_cond_wait(&owner->start, &owner->lock);
+        seen = owner->generation;
+        int task = owner->task;
+        pthread_mutex_unlock(&owner->lock);
+
+        if (task != SHARDED_REUSE_EXIT)
+            owner->run(shard, task);
+
+        pthread_mutex_lock(&owner->lock);
+        if (--owner->pending == 0)
+            pthread_cond_signal(&owner->done);
+        pthread_mutex_unlock(&owner->lock);
+
+        if (task == SHARDED_REUSE_EXIT)
+            return NULL;
+    }
+}
+
+// Runs the task on all the workers and waits for them
+void ShardedReuse::dispatch(int task) {
+    pthread_mutex_lock(&this->lock);
+    this->task = task;
+    this->pending = this->shards;
+    this->generation++;
+    pthread_cond_broadcast(&this->start);
+    while (this->pending)
+        pthread_cond_wait(&this->done, &this->lock);
+    pthread_mutex_unlock(&this->lock);
+}
+
+void ShardedReuse::run(unsigned shard, int task) {
+    map<unsigned long long, unsigned long long> &last = this->LastAccess[shard];
+
+    if (task == SHARDED_REUSE_LOOKUP) {
+        for (unsigned i = 0; i < this->count; i++) {
+            if (shardOf(this->lines[i]) != shard)
+                continue;
+
+            const auto it = last.find(this->lines[i]);
+            if (it != last.end()) {
+                this->previous[i] = it->second;
+                it->second = this->base + i;
+            } else {
+                this->previous[i] = 0;
+                last.insert(pair<unsigned long long, unsigned long long>(this->lines[i], this->base + i));
+            }
+        }
+    } else if (task == SHARDED_REUSE_RENUMBER) {
+        // The rank of a live timestamp is its new timestamp
+        for (auto it = last.begin(); it != last.end(); it++)
+            it->second = prefix(it->second);
+    }
+}
+
+// Renumbers the live timestamps 1..distinct lines and resizes the tree so
+// that it keeps room for at least as many new accesses
+void ShardedReuse::compact() {
+    dispatch(SHARDED_REUSE_RENUMBER);
+
+    unsigned long long live = distinctLines();
+
+    this->capacity = max((unsigned long long)SHARDED_REUSE_CAPACITY, 2 * live + SHARDED_REUSE_BATCH);
+    this->fenwick.assign(this->capacity + 1, 0);
+
+    // Linear construction of a tree holding ones at 1..live
+    for (unsigned long long t = 1; t <= live; t++)
+        this->fenwick[t]++;
+    for (unsigned long long t = 1; t <= this->capacity; t++) {
+        unsigned long long parent = t + (t & -t);
+        if (parent <= this->capacity)
+            this->fenwick[parent] += this->fenwick[t];
+    }
+
+    this->clock = live;
+}
+
+void ShardedReuse::flush(DataTempReuse *dtr) {
+    if (!this->count)
+        return;
+
+    if (this->clock + this->count > this->capacity)
+        compact();
+
+    this->base = this->clock + 1;
+    dispatch(SHARDED_REUSE_LOOKUP);
+
+    for (unsigned i = 0; i < this->count; i++) {
+        unsigned long long t = this->base + i;
+        unsigned long long p = this->previous[i];
+
+        if (p) {
+            // Lines whose last access falls between the two accesses
+            unsigned long long distance = prefix(t - 1) - prefix(p);
+            add(p, -1);
+
+            if (this->record[i])
+                dtr->addDistance(distance);
+        }
+
+        add(t, 1);
+    }
+
+    this->clock += this->count;
+    this->count = 0;
+}
+
+unsigned long long ShardedReuse::distinctLines() {
+    unsigned long long lines = 0;
+
+    for (unsigned i = 0; i < shards; i++)
+        lines += this->LastAccess[i].size();
+
+    return lines;
+}
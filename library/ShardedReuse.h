@@ -0,0 +1,106 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/
+
+class ShardedReuse;
+
+#ifndef LLVM_SHARDED_REUSE__H
+#define LLVM_SHARDED_REUSE__H
+
+#include <map>
+#include <vector>
+#include <pthread.h>
+
+using namespace std;
+
+class DataTempReuse;
+
+// Accesses collected before the shards resolve their previous timestamps
+#define SHARDED_REUSE_BATCH     65536
+// Smallest number of timestamps held by the Fenwick tree
+#define SHARDED_REUSE_CAPACITY  (1 << 22)
+
+#define SHARDED_REUSE_LOOKUP    0
+#define SHARDED_REUSE_RENUMBER  1
+#define SHARDED_REUSE_EXIT      2
+
+// Experimental parallel reuse distance (-dtr-shards). The last access of
+// each cache line is kept by one of several worker threads, chosen by
+// address hash. The accesses are batched: the workers resolve the previous
+// timestamp of their lines in parallel, then the owner computes the exact
+// distances in timestamp order with a Fenwick tree marking the timestamps
+// that are still the last access of a line. When the tree is full the live
+// timestamps are renumbered by their rank, again in parallel.
+class ShardedReuse {
+private:
+    unsigned shards;
+    vector<map<unsigned long long, unsigned long long>> LastAccess;
+    vector<pthread_t> workers;
+
+    // Current batch: line, previous timestamp (0 if none) and whether the
+    // distance is recorded
+    vector<unsigned long long> lines;
+    vector<unsigned long long> previous;
+    vector<bool> record;
+    unsigned count;
+
+    // Timestamp of the last processed access and of the first access of the batch
+    unsigned long long clock;
+    unsigned long long base;
+
+    vector<unsigned long long> fenwick;
+    unsigned long long capacity;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long long generation;
+    unsigned pending;
+    int task;
+
+    static void *worker(void *arg);
+    void run(unsigned shard, int task);
+    void dispatch(int task);
+    void compact();
+
+    unsigned shardOf(unsigned long long line) const {
+        return ((line * 0x9E3779B97F4A7C15ULL) >> 32) % shards;
+    }
+
+    void add(unsigned long long t, long long value) {
+        for (; t <= capacity; t += t & -t)
+            fenwick[t] += value;
+    }
+
+    unsigned long long prefix(unsigned long long t) const {
+        unsigned long long sum = 0;
+        for (; t; t -= t & -t)
+            sum += fenwick[t];
+        return sum;
+    }
+
+public:
+    ShardedReuse(unsigned shards);
+    ~ShardedReuse();
+
+    void access(unsigned long long line, bool record, DataTempReuse *dtr) {
+        this->lines[this->count] = line;
+        this->record[this->count] = record;
+        if (++this->count == SHARDED_REUSE_BATCH)
+            flush(dtr);
+    }
+
+    // Resolves the pending accesses and adds their distances to dtr
+    void flush(DataTempReuse *dtr);
+    unsigned long long distinctLines();
+};
+
+#endif // LLVM_SHARDED_REUSE__H
@@ -0,0 +1,277 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TraceFile.h"
+
+TraceWriter::TraceWriter() {
+    this->file = NULL;
+    this->buffer = NULL;
+    this->position = 0;
+    this->last_addr = 0;
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceWriter::open(const char *filename) {
+    this->file = fopen(filename, "wb");
+    if (!this->file) {
+        fprintf(stderr, "Error: can not open the trace file %s\n", filename);
+        return false;
+    }
+
+    this->buffer = new unsigned char[TRACE_BUFFER_SIZE];
+    this->position = 0;
+    this->last_addr = 0;
+
+    putRaw(TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    return true;
+}
+
+void TraceWriter::flush() {
+    if (this->position) {
+        fwrite(this->buffer, 1, this->position, this->file);
+        this->position = 0;
+    }
+}
+
+void TraceWriter::putVarint(unsigned long long value) {
+    while (value >= 0x80) {
+        this->buffer[this->position++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    this->buffer[this->position++] = (unsigned char)value;
+}
+
+void TraceWriter::putInt(int value) {
+    putVarint(((unsigned)value << 1) ^ (unsigned)(value >> 31));
+}
+
+void TraceWriter::putAddress(void *addr) {
+    long long delta = (long long)((unsigned long long)addr - this->last_addr);
+    this->last_addr = (unsigned long long)addr;
+    putVarint(((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63));
+}
+
+void TraceWriter::putRaw(const void *data, unsigned size) {
+    if (this->position + size > TRACE_BUFFER_SIZE)
+        flush();
+    memcpy(this->buffer + this->position, data, size);
+    this->position += size;
+}
+
+void TraceWriter::write(struct message *msg) {
+    if (!this->file)
+        return;
+
+    // A record is at most the type, a raw union and the varint slack
+    if (this->position + sizeof(struct message) + 32 > TRACE_BUFFER_SIZE)
+        flush();
+
+    this->buffer[this->position++] = msg->type;
+
+    switch (msg->type) {
+        case BASICBLOCK_NOTIFICATION:
+            putInt(msg->data.bb_notif.f_id);
+            putInt(msg->data.bb_notif.bb_id);
+            putInt(msg->data.bb_notif.thread_id);
+            break;
+        case MEM_ADDR_NOTIFICATION:
+            putInt(msg->data.mem_notif.f_id);
+            putInt(msg->data.mem_notif.bb_id);
+            putInt(msg->data.mem_notif.i_id);
+            putAddress(msg->data.mem_notif.addr);
+            break;
+        case FUNC_ADDRESS:
+            putInt(msg->data.mem_notif.f_id);
+            putVarint((unsigned long long)msg->data.mem_notif.addr);
+            break;
+        case MPI_UPDATE_PROCESS_ID:
+            putInt(msg->data.pid);
+            break;
+        case END_APP_NOTIFICATION:
+            break;
+        case MPI_CALL_NOTIFICATION:
+        default:
+            putRaw(&msg->data, sizeof(msg->data));
+            break;
+    }
+}
+
+void TraceWriter::close() {
+    if (this->file) {
+        flush();
+        fclose(this->file);
+        this->file = NULL;
+    }
+
+    delete[] this->buffer;
+    this->buffer = NULL;
+}
+
+TraceReader::TraceReader() {
+    this->fd = -1;
+    this->data = NULL;
+    this->size = 0;
+    this->position = NULL;
+    this->end = NULL;
+    this->last_addr = 0;
+}
+
+TraceReader::~TraceReader() {
+    close();
+}
+
+bool TraceReader::open(const char *filename) {
+    struct stat st;
+
+    this->fd = ::open(filename, O_RDONLY);
+    if (this->fd < 0)
+        return false;
+
+    if (fstat(this->fd, &st) < 0 || st.st_size < TRACE_MAGIC_SIZE) {
+        fprintf(stderr, "Error: %s is not a trace file\n", filename);
+        close();
+        return false;
+    }
+
+    this->size = st.st_size;
+    void *mapping = mmap(NULL, this->size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: can not map the trace file %s\n", filename);
+        this->size = 0;
+        close();
+        return false;
+    }
+
+    this->data = (unsigned char *)mapping;
+    madvise(this->data, this->size, MADV_SEQUENTIAL);
+
+    if (memcmp(this->data, TRACE_MAGIC, TRACE_MAGIC_SIZE)) {
+        fprintf(stderr, "Error: %s is not a trace file\n", filename);
+        close();
+        return false;
+    }
+
+    this->position = this->data + TRACE_MAGIC_SIZE;
+    this->end = this->data + this->size;
+    this->last_addr = 0;
+    return true;
+}
+
+void TraceReader::share(const TraceReader &trace) {
+    close();
+
+    this->position = trace.position;
+    this->end = trace.end;
+    this->last_addr = trace.last_addr;
+}
+
+bool TraceReader::getVarint(unsigned long long &value) {
+    unsigned shift = 0;
+
+    value = 0;
+    while (this->position < this->end && shift < 64) {
+        unsigned char byte = *this->position++;
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+        shift += 7;
+    }
+
+    return false;
+}
+
+bool TraceReader::getInt(int &value) {
+    unsigned long long v;
+    if (!getVarint(v))
+        return false;
+
+    value = (int)((unsigned)v >> 1) ^ -(int)(v & 1);
+    return true;
+}
+
+bool TraceReader::getAddress(void *&addr) {
+    unsigned long long v;
+    if (!getVarint(v))
+        return false;
+
+    long long delta = (long long)(v >> 1) ^ -(long long)(v & 1);
+    this->last_addr += delta;
+    addr = (void *)this->last_addr;
+    return true;
+}
+
+bool TraceReader::getRaw(void *data, unsigned size) {
+    if ((size_t)(this->end - this->position) < size)
+        return false;
+
+    memcpy(data, this->position, size);
+    this->position += size;
+    return true;
+}
+
+bool TraceReader::next(struct message *msg) {
+    if (this->position >= this->end)
+        return false;
+
+    memset(msg, 0, sizeof(struct message));
+    msg->type = *this->position++;
+
+    switch (msg->type) {
+        case BASICBLOCK_NOTIFICATION:
+            return getInt(msg->data.bb_notif.f_id) &&
+                   getInt(msg->data.bb_notif.bb_id) &&
+                   getInt(msg->data.bb_notif.thread_id);
+        case MEM_ADDR_NOTIFICATION:
+            return getInt(msg->data.mem_notif.f_id) &&
+                   getInt(msg->data.mem_notif.bb_id) &&
+                   getInt(msg->data.mem_notif.i_id) &&
+                   getAddress(msg->data.mem_notif.addr);
+        case FUNC_ADDRESS: {
+            unsigned long long addr;
+            if (!getInt(msg->data.mem_notif.f_id) || !getVarint(addr))
+                return false;
+            msg->data.mem_notif.addr = (void *)addr;
+            return true;
+        }
+        case MPI_UPDATE_PROCESS_ID:
+            return getInt(msg->data.pid);
+        case END_APP_NOTIFICATION:
+            return true;
+        case MPI_CALL_NOTIFICATION:
+        default:
+            return getRaw(&msg->data, sizeof(msg->data));
+    }
+}
+
+void TraceReader::close() {
+    if (this->data) {
+        munmap(this->data, this->size);
+        this->data = NULL;
+    }
+
+    if (this->fd >= 0) {
+        ::close(this->fd);
+        this->fd = -1;
+    }
+
+    this->position = this->end = NULL;
+    this->size = 0;
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/
+
+#ifndef _LIBANALYSIS_TRACE_FILE_H
+#define _LIBANALYSIS_TRACE_FILE_H
+
+#include <stdio.h>
+#include "utils.h"
+
+// Recorded event trace: the 'struct message' stream of one client
+// connection, written by the decoupled client when PISA_RECORD_TRACE is set
+// and replayed by 'server -replay'.
+//
+// The file starts with TRACE_MAGIC. Each record is the message type followed
+// by its fields as LEB128 varints (zig-zag for signed integers). Memory
+// addresses are stored as the difference from the previous address of the
+// same stream. MPI calls and unknown types are stored raw.
+#define TRACE_MAGIC         "PISATRC1"
+#define TRACE_MAGIC_SIZE    8
+#define TRACE_BUFFER_SIZE   (1 << 20)
+
+class TraceWriter {
+private:
+    FILE *file;
+    unsigned char *buffer;
+    unsigned position;
+    unsigned long long last_addr;
+
+    void flush();
+    void putVarint(unsigned long long value);
+    void putInt(int value);
+    void putAddress(void *addr);
+    void putRaw(const void *data, unsigned size);
+
+public:
+    TraceWriter();
+    ~TraceWriter();
+
+    bool open(const char *filename);
+    void write(struct message *msg);
+    void close();
+};
+
+class TraceReader {
+private:
+    int fd;
+    unsigned char *data;
+    size_t size;
+    const unsigned char *position;
+    const unsigned char *end;
+    unsigned long long last_addr;
+
+    bool getVarint(unsigned long long &value);
+    bool getInt(int &value);
+    bool getAddress(void *&addr);
+    bool getRaw(void *data, unsigned size);
+
+public:
+    TraceReader();
+    ~TraceReader();
+
+    bool open(const char *filename);
+    // Reads the same mapping as trace, from its current position, without
+    // copying it. trace must stay open while this reader is used.
+    void share(const TraceReader &trace);
+    // Decodes the next record into msg; false at the end of the trace
+    // (or on a truncated record)
+    bool next(struct message *msg);
+    void close();
+};
+
+#endif // _LIBANALYSIS_TRACE_FILE_H
@@ -28,7 +28,10 @@ WKLDchar::WKLDchar(Module *M,
                    int processor_id, 
                    pthread_mutex_t *print_lock, 
                    pthread_mutex_t *output_lock, 
-                   char *branch_entropy_file) {
+                   char *branch_entropy_file,
+                   unsigned long long interval_size,
+                   unsigned long long bbv_interval_size,
+                   char *interval_file) {
     this->M = M;
     this->flags = flags;
     this->thread_id = thread_id;
@@ -113,8 +116,10 @@ WKLDchar::WKLDchar(Module *M,
                                          thread_id, 
                                          this->processor_id, 
                                          false, 
-                                         false, 
-                                         branch_entropy_file));
+                                         branch_shard_entries, 
+                                         branch_entropy_file,
+                                         (flags & BRANCH_ENTROPY_ONLINE) ? branch_history : 0,
+                                         flags & BRANCH_TRACE_BINARY));
         this->be->printHeader();
     } else if (flags & PRINT_BRANCH_COND) {
         this->be.reset(new BranchEntropy(M, 
@@ -122,8 +127,10 @@ WKLDchar::WKLDchar(Module *M,
                                          thread_id, 
                                          this->processor_id, 
                                          false, 
-                                         false, 
-                                         branch_entropy_file));
+                                         branch_shard_entries, 
+                                         branch_entropy_file,
+                                         (flags & BRANCH_ENTROPY_ONLINE) ? branch_history : 0,
+                                         flags & BRANCH_TRACE_BINARY));
         this->be->printHeader();
     }
 
@@ -151,6 +158,31 @@ WKLDchar::WKLDchar(Module *M,
     // External function calls counting analysis
     if (flags & ANALYZE_EXTERNALLIBS_CALLS)
         this->elc.reset(new ExternalLibraryCount(M, thread_id, this->processor_id));
+
+    // Per-interval time series
+    if (flags & ANALYZE_INTERVALS)
+        this->intervals.reset(new IntervalProfile(M, 
+                                                  thread_id, 
+                                                  this->processor_id, 
+                                                  interval_size, 
+                                                  interval_file ? interval_file : ""));
+
+    // Basic block vectors (SimPoint)
+    if (flags & ANALYZE_BBV)
+        this->bbv.reset(new BasicBlockVector(M, 
+                                             thread_id, 
+                                             this->processor_id, 
+                                             bbv_interval_size, 
+                                             interval_file ? interval_file : ""));
+
+    initFastForward();
+    selectAnalyzer();
+
+    // Instruction mix computed from the basic block executions
+    if (flags & ANALYZE_STATIC_MIX) {
+        build_basicblock_index(M);
+        this->bb_executions.assign(BasicBlockPointers.size(), 0);
+    }
 }
 
 // Decoupled PISA constructor
@@ -171,7 +203,10 @@ WKLDchar::WKLDchar(Module *M,
                    pthread_mutex_t *db_lock,
                    int accMode,
                    pthread_mutex_t* output_lock, 
-                   char *branch_entropy_file) {
+                   char *branch_entropy_file,
+                   unsigned long long interval_size,
+                   unsigned long long bbv_interval_size,
+                   char *interval_file) {
     this->M = M;
     this->flags = flags;
 
@@ -255,8 +290,10 @@ WKLDchar::WKLDchar(Module *M,
                                          thread_id, 
                                          this->processor_id, 
                                          false, 
-                                         false, 
-                                         branch_entropy_file));
+                                         branch_shard_entries, 
+                                         branch_entropy_file,
+                                         (flags & BRANCH_ENTROPY_ONLINE) ? branch_history : 0,
+                                         flags & BRANCH_TRACE_BINARY));
         this->be->printHeader();
     } else if (flags & PRINT_BRANCH_COND) {
         this->be.reset(new BranchEntropy(M, 
@@ -264,8 +301,10 @@ WKLDchar::WKLDchar(Module *M,
                                          thread_id, 
                                          this->processor_id, 
                                          false, 
-                                         false, 
-                                         branch_entropy_file));
+                                         branch_shard_entries, 
+                                         branch_entropy_file,
+                                         (flags & BRANCH_ENTROPY_ONLINE) ? branch_history : 0,
+                                         flags & BRANCH_TRACE_BINARY));
         this->be->printHeader();
     }
     // MPI calls analysis
@@ -292,30 +331,150 @@ WKLDchar::WKLDchar(Module *M,
     // ExternalLibraryCount calls analysis
     if (flags & ANALYZE_EXTERNALLIBS_CALLS)
         this->elc.reset(new ExternalLibraryCount(M, thread_id, this->processor_id));
+
+    // Per-interval time series
+    if (flags & ANALYZE_INTERVALS)
+        this->intervals.reset(new IntervalProfile(M, 
+                                                  thread_id, 
+                                                  this->processor_id, 
+                                                  interval_size, 
+                                                  interval_file ? interval_file : ""));
+
+    // Basic block vectors (SimPoint)
+    if (flags & ANALYZE_BBV)
+        this->bbv.reset(new BasicBlockVector(M, 
+                                             thread_id, 
+                                             this->processor_id, 
+                                             bbv_interval_size, 
+                                             interval_file ? interval_file : ""));
+
+    initFastForward();
+    selectAnalyzer();
+
+    // Instruction mix computed from the basic block executions
+    if (flags & ANALYZE_STATIC_MIX) {
+        build_basicblock_index(M);
+        this->bb_executions.assign(BasicBlockPointers.size(), 0);
+    }
+}
+
+void WKLDchar::initFastForward() {
+    this->fast_forward = this->flags & ANALYZE_FAST_FORWARD;
+    this->ff_state = FF_SKIP;
+    this->ff_position = 0;
+    this->ff_window_id = 0;
+    this->ff_analyzed_windows = 0;
+    this->dtr_clock = 0;
+
+    if (this->fast_forward) {
+        build_basicblock_index(M);
+        nextFastForwardWindow();
+    }
 }
 
-void WKLDchar::analyze(Instruction &I) {
+// Moves to the analysis window ff_window_id, or disables the analysis for
+// the rest of the execution if there is none left
+void WKLDchar::nextFastForwardWindow() {
+    unsigned long long start, end;
+
+    this->ff_window_counted = false;
+
+    if (get_fast_forward_window(this->ff_window_id, start, end)) {
+        this->ff_start = start;
+        this->ff_end = end;
+        this->ff_warmup_start = start > ff_warmup ? start - ff_warmup : 0;
+    } else {
+        this->ff_start = ULLONG_MAX;
+        this->ff_end = ULLONG_MAX;
+        this->ff_warmup_start = ULLONG_MAX;
+    }
+}
+
+// Called once per executed basic block. The positions count the non-phi
+// instructions of the executed blocks, as the basic block vectors do. The
+// whole block is analysed, warms up the DTR state or is skipped, depending on
+// the position of its first instruction. Returns the FF_* state of the block.
+int WKLDchar::fastForwardBlock(int f, int bb) {
+    unsigned long long position = this->ff_position;
+    this->ff_position += BasicBlockSizes[BasicBlockOffsets[f] + bb];
+
+    while (position >= this->ff_end) {
+        this->ff_window_id++;
+        nextFastForwardWindow();
+    }
+
+    if (position >= this->ff_start) {
+        if (!this->ff_window_counted) {
+            this->ff_analyzed_windows++;
+            this->ff_window_counted = true;
+        }
+        this->ff_state = FF_ANALYZE;
+    } else if (position >= this->ff_warmup_start) {
+        this->ff_state = FF_WARMUP;
+    } else {
+        this->ff_state = FF_SKIP;
+    }
+
+    return this->ff_state;
+}
+
+#define WKLD_ANALYZER(n) &WKLDchar::analyzeWith<((n) & 1) != 0, ((n) & 2) != 0, ((n) & 4) != 0, ((n) & 8) != 0>
+
+void WKLDchar::selectAnalyzer() {
+    static const Analyzer analyzers[16] = {
+        WKLD_ANALYZER(0),  WKLD_ANALYZER(1),  WKLD_ANALYZER(2),  WKLD_ANALYZER(3),
+        WKLD_ANALYZER(4),  WKLD_ANALYZER(5),  WKLD_ANALYZER(6),  WKLD_ANALYZER(7),
+        WKLD_ANALYZER(8),  WKLD_ANALYZER(9),  WKLD_ANALYZER(10), WKLD_ANALYZER(11),
+        WKLD_ANALYZER(12), WKLD_ANALYZER(13), WKLD_ANALYZER(14), WKLD_ANALYZER(15)
+    };
+
+    bool withOthers = this->rc || this->ls || this->be || this->mpi_stats ||
+                      this->openmp_stats || this->elc || this->intervals;
+
+    this->analyzer = analyzers[(this->ilp ? 1 : 0) | (this->dtr ? 2 : 0) |
+                               (this->itr ? 4 : 0) | (withOthers ? 8 : 0)];
+}
+
+template <bool withILP, bool withDTR, bool withITR, bool withOthers>
+void WKLDchar::analyzeWith(Instruction &I) {
+    // Outside the analysis windows the memory accesses only warm up the DTR state
+    if (this->fast_forward && this->ff_state != FF_ANALYZE) {
+        if (this->ff_state == FF_WARMUP && this->dtr && !isa<PHINode>(I)) {
+            this->dtr->record = false;
+            this->dtr->visit(I, ++this->dtr_clock);
+            this->dtr->record = true;
+        }
+        return;
+    }
+
+    // The instruction is classified once for all the analyses
+    int InstType = this->mix->getInstType(I);
+
     // Instruction Level Parallelism Analysis
     // This needs to be done before instruction mix
-    if (this->ilp) this->ilp->visit(I);
+    if (withILP) this->ilp->visit(I, InstType);
 
-    if (isa<PHINode>(I)) return;
+    if (InstType == PHI_TYPE) return;
 
     // Update instruction mix counters
     this->mix->visit(I);
     this->mix->visitMemoryInstruction(I);
-    this->mix->visitBinaryArithBitwiseCmpConvertSelectInstruction(I);
+    this->mix->visitBinaryArithBitwiseCmpConvertSelectInstruction(I, InstType);
     
     unsigned long long CurrentIssueCycle = this->mix->getNumTotalInsts();
 
     // data temporal reuse analysis
-    if (this->dtr) 
-        this->dtr->visit(I, CurrentIssueCycle);
+    // The DTR clock keeps running during the warm-up periods
+    if (withDTR) 
+        this->dtr->visit(I, ++this->dtr_clock);
 
     // instruction temporal reuse analysis
-    if (this->itr) 
+    if (withITR) 
         this->itr->visit(I, CurrentIssueCycle);
 
+    if (!withOthers)
+        return;
+
     // register counting
     if (this->rc) 
         this->rc->visit(I);
@@ -340,6 +499,30 @@ void WKLDchar::analyze(Instruction &I) {
     if (this->elc)
         this->elc->visit(I);
 
+    // Per-interval time series
+    if (this->intervals && CurrentIssueCycle >= this->intervals->next_sample)
+        this->intervals->sample(this->mix.get(), this->ilp.get(), this->dtr.get());
+}
+
+// Called once per executed basic block, with the ids inserted by the pass
+void WKLDchar::visitBasicBlock(int f, int bb) {
+    if (this->bbv)
+        this->bbv->visit(f, bb);
+}
+
+// Static mix mode: the instructions of the block are accounted at dump time
+void WKLDchar::countBasicBlock(int f, int bb) {
+    this->bb_executions[BasicBlockOffsets[f] + bb]++;
+}
+
+// Expands the basic block executions into the instruction mix
+void WKLDchar::foldStaticMix() {
+    for (unsigned id = 0; id < this->bb_executions.size(); id++) {
+        if (this->bb_executions[id]) {
+            this->mix->visitStaticBasicBlock(*BasicBlockPointers[id], this->bb_executions[id]);
+            this->bb_executions[id] = 0;
+        }
+    }
 }
 
 void WKLDchar::process_mpi_map(Instruction *I, struct message *msg, int tag, int inFunction) {
@@ -352,12 +535,51 @@ void WKLDchar::process_mpi_data(Instruction *I, struct message *msg) {
         this->mpi_data->visit(I, msg);
 }
 
+// Takes over the analyses that other ran on the same event stream (parallel
+// replay). The instruction mix, computed by both, is kept.
+void WKLDchar::mergeAnalyses(WKLDchar &other) {
+    this->flags |= other.flags;
+
+    if (!this->ilp)
+        this->ilp = std::move(other.ilp);
+    if (!this->dtr)
+        this->dtr = std::move(other.dtr);
+    if (!this->itr)
+        this->itr = std::move(other.itr);
+    if (!this->rc)
+        this->rc = std::move(other.rc);
+    if (!this->ls)
+        this->ls = std::move(other.ls);
+    if (!this->be)
+        this->be = std::move(other.be);
+    if (!this->mpi_stats)
+        this->mpi_stats = std::move(other.mpi_stats);
+    if (!this->mpi_map)
+        this->mpi_map = std::move(other.mpi_map);
+    if (!this->mpi_data)
+        this->mpi_data = std::move(other.mpi_data);
+    if (!this->openmp_stats)
+        this->openmp_stats = std::move(other.openmp_stats);
+    if (!this->elc)
+        this->elc = std::move(other.elc);
+}
+
 unsigned long long WKLDchar::getInstCount() {
     return this->mix->getNumTotalInsts();
 }
 
 void WKLDchar::JSONdump(JSONmanager *JSONwriter, unsigned long long sharedBytes, unsigned long long sharedAccesses) {
 
+    // Flush the last (partial) interval
+    if (this->intervals)
+        this->intervals->sample(this->mix.get(), this->ilp.get(), this->dtr.get());
+
+    if (this->bbv)
+        this->bbv->finish();
+
+    if (!this->bb_executions.empty())
+        foldStaticMix();
+
     JSONwriter->StartObject();
 
     JSONwriter->String("threadId");
@@ -366,6 +588,16 @@ void WKLDchar::JSONdump(JSONmanager *JSONwriter, unsigned long long sharedBytes,
     JSONwriter->String("processId");
     JSONwriter->Uint64(processor_id);
     
+    if (this->fast_forward) {
+        JSONwriter->String("fastForward");
+        JSONwriter->StartObject();
+        JSONwriter->String("executedInstructions");
+        JSONwriter->Uint64(ff_position);
+        JSONwriter->String("analyzedWindows");
+        JSONwriter->Uint64(ff_analyzed_windows);
+        JSONwriter->EndObject();
+    }
+
     this->mix->JSONdump_vectorIncluded(JSONwriter);
 
     if (this->openmp_stats) 
@@ -407,6 +639,9 @@ void WKLDchar::JSONdump(JSONmanager *JSONwriter, unsigned long long sharedBytes,
     if (this->elc)
         this->elc->JSONdump(JSONwriter);
 
+    if (this->be)
+        this->be->JSONdump(JSONwriter);
+
     JSONwriter->EndObject();
 }
 
@@ -437,6 +672,10 @@ void WKLDchar::update_processor_id(int processor_id) {
         openmp_stats->processor_id = processor_id;
     if (elc) 
         elc->processor_id = processor_id;
+    if (intervals)
+        intervals->processor_id = processor_id;
+    if (bbv)
+        bbv->processor_id = processor_id;
 
     // FIXME: this is not gonna work for MPI+OpenMP applications. Either MPI or OpenMP!
     if(weDecoupled){
@@ -464,6 +703,10 @@ void WKLDchar::update_processor_id(int processor_id) {
             openmp_stats->thread_id = processor_id;
         if (elc)
             elc->thread_id = processor_id;
+        if (intervals)
+            intervals->thread_id = processor_id;
+        if (bbv)
+            bbv->thread_id = processor_id;
     }
 }
 
@@ -32,12 +32,45 @@ class WKLDchar;
 #include "ILP.h"
 #include "OpenMPstats.h"
 #include "ExternalLibraryCount.h"
+#include "IntervalProfile.h"
+#include "BasicBlockVector.h"
 #include "JSONmanager.h"
 
 class WKLDchar {
     Module *M;
     int flags;
 
+    // Fast-forward state (ANALYZE_FAST_FORWARD)
+    bool fast_forward;
+    int ff_state;
+    unsigned long long ff_position;
+    unsigned long long ff_window_id;
+    unsigned long long ff_warmup_start;
+    unsigned long long ff_start;
+    unsigned long long ff_end;
+    unsigned long long ff_analyzed_windows;
+    // Whether the window ff_window_id was already counted in ff_analyzed_windows
+    bool ff_window_counted;
+    // Timestamp of the memory accesses seen by the DTR analysis
+    unsigned long long dtr_clock;
+
+    // Executions of each basic block (ANALYZE_STATIC_MIX), indexed by
+    // BasicBlockOffsets[f] + bb
+    vector<unsigned long long> bb_executions;
+
+    // Per-instruction entry point specialised for the active analyses.
+    // ILP, DTR and ITR are template parameters; the remaining analyses
+    // (withOthers) are checked at run time.
+    typedef void (WKLDchar::*Analyzer)(Instruction &I);
+    Analyzer analyzer;
+
+    template <bool withILP, bool withDTR, bool withITR, bool withOthers>
+    void analyzeWith(Instruction &I);
+    void selectAnalyzer();
+
+    void initFastForward();
+    void nextFastForwardWindow();
+
 public:
     int thread_id;
     int processor_id;
@@ -55,6 +88,8 @@ public:
     std::unique_ptr<ILP> ilp;
     std::unique_ptr<OpenMPstats> openmp_stats;
     std::unique_ptr<ExternalLibraryCount> elc;
+    std::unique_ptr<IntervalProfile> intervals;
+    std::unique_ptr<BasicBlockVector> bbv;
 
     // Coupled constructor
     WKLDchar(Module *M, 
@@ -71,9 +106,12 @@ public:
              int processor_id, 
              pthread_mutex_t *print_lock,
              pthread_mutex_t *output_lock, 
-             char *branch_entropy_file);
+             char *branch_entropy_file,
+             unsigned long long interval_size,
+             unsigned long long bbv_interval_size,
+             char *interval_file);
 
-    WKLDchar(){};
+    WKLDchar() : fast_forward(false), analyzer(NULL) {};
 
     // Decoupled constructor
     WKLDchar(Module *M, 
@@ -93,10 +131,20 @@ public:
              pthread_mutex_t *db_lock,
              int accMode, 
              pthread_mutex_t* output_lock, /* This protects a critical section that only prints debugging messages in ILP. */
-             char *branch_entropy_file);
+             char *branch_entropy_file,
+             unsigned long long interval_size,
+             unsigned long long bbv_interval_size,
+             char *interval_file);
 
 
-    void analyze(Instruction &I);
+    void analyze(Instruction &I) { (this->*analyzer)(I); }
+    void visitBasicBlock(int f, int bb);
+    int fastForwardBlock(int f, int bb);
+    // Fast-forward: the current basic block is neither analysed nor warms up
+    bool skipping() const { return fast_forward && ff_state == FF_SKIP; }
+    void countBasicBlock(int f, int bb);
+    void foldStaticMix();
+    void mergeAnalyses(WKLDchar &other);
     void process_mpi_map(Instruction *I, struct message *msg, int tag, int inFunction);
     void process_mpi_data(Instruction *I, struct message *msg);
     void JSONdump(JSONmanager *JSONwriter, unsigned long long sharedBytes, unsigned long long sharedAccesses);
@@ -0,0 +1,221 @@
+/*******************************************************************************
+ * (C) Copyright IBM Corporation 2017
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ * Contributors:
+ *    IBM Algorithms & Machines team
+ *******************************************************************************/
+
+// Merges the per-rank outputs written with -json-per-rank (PREFIX.rank.0,
+// PREFIX.rank.1, ...) into the single document written without it: the
+// members of rank 0 followed by the "threads" array of all ranks in rank
+// order. The files are parsed with the SAX reader and the events forwarded
+// to the output, so the memory does not depend on the number or the size
+// of the files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "rapidjson/reader.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/error/en.h"
+
+using namespace std;
+
+#define MERGE_BUFFER_SIZE 65536
+
+#define MERGE_BEFORE_THREADS    0
+#define MERGE_THREADS_KEY       1
+#define MERGE_IN_THREADS        2
+#define MERGE_AFTER_THREADS     3
+
+// Forwards the elements of the "threads" array of a rank file to writer. The
+// members preceding it are forwarded only for the first file; the array and
+// the document are never closed here.
+template <typename Writer>
+class MergeHandler {
+private:
+    Writer &writer;
+    bool header;
+    int depth;
+    int state;
+
+    // Decides whether the event is forwarded (1), skipped (0) or invalid (-1)
+    // and tracks where we are. open/close tell whether the event starts or
+    // ends a container, array whether it starts an array.
+    int forward(bool open, bool close, bool array) {
+        int copy = 0;
+
+        switch (state) {
+            case MERGE_BEFORE_THREADS:
+                copy = header;
+                break;
+            case MERGE_THREADS_KEY:
+                if (!array) {
+                    fprintf(stderr, "Error: \"threads\" is not an array\n");
+                    return -1;
+                }
+                state = MERGE_IN_THREADS;
+                copy = header;
+                break;
+            case MERGE_IN_THREADS:
+                if (close && depth == 2)
+                    state = MERGE_AFTER_THREADS;
+                else
+                    copy = 1;
+                break;
+        }
+
+        if (open)
+            depth++;
+        if (close)
+            depth--;
+
+        return copy;
+    }
+
+public:
+    MergeHandler(Writer &writer, bool header) : writer(writer) {
+        this->header = header;
+        this->depth = 0;
+        this->state = MERGE_BEFORE_THREADS;
+    }
+
+    bool complete() const { return state == MERGE_AFTER_THREADS; }
+
+#define MERGE_EVENT(open, close, array, call) \
+    { int event = forward(open, close, array); return event > 0 ? writer.call : event == 0; }
+
+    bool Null() MERGE_EVENT(false, false, false, Null())
+    bool Bool(bool b) MERGE_EVENT(false, false, false, Bool(b))
+    bool Int(int i) MERGE_EVENT(false, false, false, Int(i))
+    bool Uint(unsigned u) MERGE_EVENT(false, false, false, Uint(u))
+    bool Int64(int64_t i) MERGE_EVENT(false, false, false, Int64(i))
+    bool Uint64(uint64_t u) MERGE_EVENT(false, false, false, Uint64(u))
+    bool Double(double d) MERGE_EVENT(false, false, false, Double(d))
+    bool RawNumber(const char *str, rapidjson::SizeType length, bool copy)
+        MERGE_EVENT(false, false, false, RawNumber(str, length, copy))
+    bool String(const char *str, rapidjson::SizeType length, bool copy)
+        MERGE_EVENT(false, false, false, String(str, length, copy))
+    bool StartObject() MERGE_EVENT(true, false, false, StartObject())
+    bool EndObject(rapidjson::SizeType) MERGE_EVENT(false, true, false, EndObject())
+    bool StartArray() MERGE_EVENT(true, false, true, StartArray())
+    bool EndArray(rapidjson::SizeType) MERGE_EVENT(false, true, false, EndArray())
+
+#undef MERGE_EVENT
+
+    // Keys are not values: they only move from the header to the array
+    bool Key(const char *str, rapidjson::SizeType length, bool copy) {
+        if (state == MERGE_BEFORE_THREADS && depth == 1 && !strcmp(str, "threads")) {
+            state = MERGE_THREADS_KEY;
+            return header ? writer.Key(str, length, copy) : true;
+        }
+
+        bool forwarded = state == MERGE_IN_THREADS || (state == MERGE_BEFORE_THREADS && header);
+        return forwarded ? writer.Key(str, length, copy) : true;
+    }
+};
+
+template <typename Writer>
+static bool merge_file(const char *filename, Writer &writer, bool header) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+        return false;
+
+    char buffer[MERGE_BUFFER_SIZE];
+    rapidjson::FileReadStream is(fp, buffer, sizeof(buffer));
+    rapidjson::Reader reader;
+    MergeHandler<Writer> handler(writer, header);
+
+    rapidjson::ParseResult result = reader.Parse<rapidjson::kParseIterativeFlag>(is, handler);
+    fclose(fp);
+
+    if (result.IsError()) {
+        fprintf(stderr, "Error: %s at offset %lu of %s\n", rapidjson::GetParseError_En(result.Code()),
+                (unsigned long)result.Offset(), filename);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!handler.complete()) {
+        fprintf(stderr, "Error: %s has no \"threads\" array\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+template <typename Writer>
+static int merge(const char *prefix, rapidjson::FileWriteStream &os) {
+    Writer writer(os);
+    int rank = 0;
+
+    while (merge_file((string(prefix) + ".rank." + to_string(rank)).c_str(), writer, rank == 0))
+        rank++;
+
+    if (rank == 0)
+        return 0;
+
+    writer.EndArray();
+    writer.EndObject();
+    return rank;
+}
+
+static void print_usage(char *exe_path) {
+    fprintf(stderr, "Usage: %s [-compact] OUTPUT PREFIX\n", exe_path);
+    fprintf(stderr, "\tMerges PREFIX.rank.0, PREFIX.rank.1, ... (up to the first missing rank) into OUTPUT\n");
+    fprintf(stderr, "\t-compact - write the JSON output without indentation\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+    bool compact = false;
+    int arg = 1;
+
+    if (arg < argc && !strcmp(argv[arg], "-compact")) {
+        compact = true;
+        arg++;
+    }
+
+    if (argc - arg != 2)
+        print_usage(argv[0]);
+
+    const char *output = argv[arg];
+    const char *prefix = argv[arg + 1];
+
+    FILE *fp = fopen(output, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: can not open the output file %s\n", output);
+        return EXIT_FAILURE;
+    }
+
+    char buffer[MERGE_BUFFER_SIZE];
+    rapidjson::FileWriteStream os(fp, buffer, sizeof(buffer));
+
+    int ranks;
+    if (compact)
+        ranks = merge<rapidjson::Writer<rapidjson::FileWriteStream>>(prefix, os);
+    else
+        ranks = merge<rapidjson::PrettyWriter<rapidjson::FileWriteStream>>(prefix, os);
+
+    os.Put('\n');
+    os.Flush();
+    fclose(fp);
+
+    if (ranks == 0) {
+        fprintf(stderr, "Error: can not open %s.rank.0\n", prefix);
+        remove(output);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Merged %d ranks into %s\n", ranks, output);
+    return EXIT_SUCCESS;
+}
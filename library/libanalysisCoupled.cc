@@ -91,6 +91,8 @@ int inst_size = 0;
 int window_size = 0;
 int ilp_type = 0;
 int debug_flag = 0;
+unsigned long long interval_size = 0;
+unsigned long long bbv_interval_size = 0;
 bool mpi_map_active = false;
 
 char *AppName;
@@ -98,6 +100,8 @@ char *TestName;
 char *PISAFileName;
 char *AddJSONData;
 char *branch_entropy_file;
+char *interval_file;
+char *ff_simpoints_file;
 
 
 // This flag is used to memorize the LLVM address (the register)
@@ -192,8 +196,6 @@ extern "C" void end_app(void) {
         if(ls_semaphor && ls_semaphor != SEM_FAILED)
             sem_wait(ls_semaphor);
     */
-    int procWriting = 0;
-    int procWrote = -1;
     int procId = 0;
     int procCount = 1;
     int masterId = 0;
@@ -203,39 +205,43 @@ extern "C" void end_app(void) {
         MPI_Comm_size(MPI_COMM_WORLD, &procCount);
     }
 
+    // Per-rank files need a file name to derive them from
+    bool perRank = mpiExecution && (options & JSON_PER_RANK) && PISAFileName != NULL && strlen(PISAFileName) > 0;
+
     JSONmanager JSONman(procId, options, &WKLDcharForThreads);	
-    if(procId==0){
+    if(perRank){
+        // Every rank is the master of its own file; json_merge combines them
+        string rankFileName = string(PISAFileName) + ".rank." + to_string(procId);
         #if DEBUG_END_APP
-            fprintf(stderr,"libanalysisCoupled: Process %d opening JSON as master\n",procId);
+            fprintf(stderr,"libanalysisCoupled: Process %d opening JSON %s\n",procId,rankFileName.c_str());
         #endif
-        JSONman.openMaster(PISAFileName, AddJSONData, AppName, TestName);
+        JSONman.openMaster((char*)rankFileName.c_str(), AddJSONData, AppName, TestName);
+        JSONman.dump(procId);
     }
     else{
-        #if DEBUG_END_APP
-            fprintf(stderr,"libanalysisCoupled: Process %d opening JSON as slave\n",procId);
-        #endif
-        JSONman.openSlave(masterId);// FIXME: parameters masterId
-    }
-        
-    for(procWriting=0 ; procWriting < procCount ; procWriting++){
-        if(procWriting == procId){// Writing turn of this process
-            procWrote = procId;
-        }// Writing completed
-        
-        // In this function the JSONman master either dump his own JSON or it sets in receiving mode listening for the slave
-        // The JSONman slaves either send data to the master or do nothing.
-        JSONman.dump(procWriting);
-        
-        if(mpiExecution){
+        if(procId==0){
+            #if DEBUG_END_APP
+                fprintf(stderr,"libanalysisCoupled: Process %d opening JSON as master\n",procId);
+            #endif
+            JSONman.openMaster(PISAFileName, AddJSONData, AppName, TestName);
+        }
+        else{
             #if DEBUG_END_APP
-                fprintf(stderr,"libanalysisCoupled: Process %d entering Bcast synchronization. procWriting %d, procWrote %d\n", procId, procWriting, procWrote);
+                fprintf(stderr,"libanalysisCoupled: Process %d opening JSON as slave\n",procId);
             #endif
-        MPI_Bcast(&procWrote, 1, MPI_INT, procWriting, MPI_COMM_WORLD);// Synchronizing
+            JSONman.openSlave(masterId);// FIXME: parameters masterId
+        }
+        
+        // Every process writes (master) or buffers (slaves) its own threads,
+        // then the slaves' buffers are collected by the master in one collective.
+        JSONman.dump(procId);
+
+        if(mpiExecution){
             #if DEBUG_END_APP
-                fprintf(stderr,"libanalysisCoupled: Process %d exiting Bcast synchronization. procWriting %d, procWrote %d\n", procId, procWriting, procWrote);
+                fprintf(stderr,"libanalysisCoupled: Process %d entering JSON gather\n", procId);
             #endif
-        assert(procWrote == procWriting);
-      }
+            JSONman.gather(procCount);
+        }
     }
 
     JSONman.close();
@@ -385,6 +391,9 @@ static bool check_if_bb_is_in_excluded_functions(Function::iterator BB, const in
 static void iter_instructions(Function::iterator BB, BasicBlock::iterator I_init, const int thread_id) {
     Instruction *last_processed_inst = NULL;
 
+    if ((options & ANALYZE_FAST_FORWARD) && WKLDcharForThreads[thread_id].skipping())
+        return;
+
     get_per_thread_info(thread_id);
 
     for (BasicBlock::iterator I = I_init, J = BB->end(); I != J; ++I) {
@@ -478,6 +487,147 @@ static void iter_instructions(Function::iterator BB, BasicBlock::iterator I_init
     }
 }
 
+// This function processes a segment of a basic block whose memory addresses
+// were delivered at once (ANALYZE_BATCH_MEMORY). A segment ends with a call
+// (except LLVM's intrinsics) or with the terminator, so the processing never
+// needs to be interrupted by a load/store instruction.
+static void iter_batch(Function::iterator BB, BasicBlock::iterator I, void **addrs, int n, const int thread_id) {
+    Instruction *last_processed_inst = NULL;
+    int k = 0;
+
+    get_per_thread_info(thread_id);
+
+    // The call trace does not change inside a segment
+    bool analyzed = check_if_bb_is_in_included_functions(BB, thread_id) &&
+                    !check_if_bb_is_in_excluded_functions(BB, thread_id);
+
+    for (BasicBlock::iterator J = BB->end(); I != J; ++I) {
+        Function *_call = NULL;
+        if (!strcmp(I->getOpcodeName(), "call")) {
+            CallInst *call = cast<CallInst>(I);
+            _call = get_calledFunction(call);
+
+            if (!_call) {
+                Value * a = (Function *)call->getCalledValue();
+                void *addr = getMemoryAddress((Instruction *)a, thread_id);
+                if (addr)
+                    addr = (void *)*(unsigned long long *)addr;
+                _call = getFunctionAddress(addr);
+            }
+
+            // We are ignoring LLVM's debugging functions
+            if (_call && !strncmp(_call->getName().str().c_str(), "llvm.", 5))
+                continue;
+        }
+
+        if (!strcmp(I->getOpcodeName(), "load") || !strcmp(I->getOpcodeName(), "store")) {
+            if (k < n && !mpi_ignore)
+                updateMemory((Instruction*)I, addrs[k], thread_id);
+            k++;
+        }
+
+        if (analyzed)
+            process_instr((Instruction*)I, thread_id);
+
+        last_processed_inst = (Instruction*)I;
+
+        // The next segment is notified after the call returns
+        if (!strcmp(I->getOpcodeName(), "call")) {
+            if (_call && _call->begin() != _call->end()) {
+                // call to a internal module function; push state
+                struct state current_state;
+                current_state.BB = BB;
+                ++I;
+                current_state.I = I;
+                SavedStatesForThreads[thread_id].push_back(current_state);
+            }
+            return;
+        }
+    }
+
+    // Back from an internal function: the rest of the caller's basic block
+    // is delivered by its own segment, only the call trace is restored.
+    if (!SavedStatesForThreads[thread_id].empty() && last_processed_inst && !strcmp(last_processed_inst->getOpcodeName(), "ret")) {
+        struct state next_state = SavedStatesForThreads[thread_id].back();
+        SavedStatesForThreads[thread_id].pop_back();
+        if (options & ANALYZE_ILP) {
+            next_state.I--;
+            WKLDcharForThreads[thread_id].updateILPforCall(last_processed_inst, (Instruction*)next_state.I);
+        }
+    }
+}
+
+// Fast-forward: positions the thread at the bb basic block and tells whether
+// its instructions are processed. The skipped blocks are not decoded, so
+// their calls and returns are not followed: the call trace is dropped and
+// an analysis window starts with an empty one.
+static bool fast_forward_block(int f, int bb, const int thread_id) {
+    if (WKLDcharForThreads[thread_id].fastForwardBlock(f, bb) != FF_SKIP)
+        return true;
+
+    SavedStatesForThreads[thread_id].clear();
+    return false;
+}
+
+// This is a library call that delivers the memory addresses of the
+// load/store instructions of a segment of the bb basic block, starting
+// from the instruction first (ANALYZE_BATCH_MEMORY).
+extern "C" void mem_batch_notification(int f, int bb, int first, void **addrs, int n) {
+    if (!M)
+        return;
+
+    const int thread_id = omp_get_thread_num();
+
+    if (first == 0) {
+        if (options & ANALYZE_BBV)
+            WKLDcharForThreads[thread_id].visitBasicBlock(f, bb);
+
+        if ((options & ANALYZE_FAST_FORWARD) && !fast_forward_block(f, bb, thread_id))
+            return;
+    } else if ((options & ANALYZE_FAST_FORWARD) && WKLDcharForThreads[thread_id].skipping()) {
+        return;
+    }
+
+    Function::iterator BB = get_basicblock(f, bb, M.get());
+
+    if (first == 0)
+        iter_batch(BB, BB->begin(), addrs, n, thread_id);
+    else
+        iter_batch(BB, get_instruction(f, bb, first, M.get()), addrs, n, thread_id);
+}
+
+// Basic blocks calling 'exit' (ANALYZE_STATIC_MIX), indexed by BasicBlockOffsets[f] + bb
+static vector<bool> ExitBasicBlocks;
+
+static void find_exit_basicblocks(void) {
+    build_basicblock_index(M.get());
+    ExitBasicBlocks.assign(BasicBlockPointers.size(), false);
+
+    for (unsigned id = 0; id < BasicBlockPointers.size(); id++)
+        for (BasicBlock::iterator I = BasicBlockPointers[id]->begin(), J = BasicBlockPointers[id]->end(); I != J; ++I)
+            if (CallInst *call = dyn_cast<CallInst>(I)) {
+                Function *F = get_calledFunction(call);
+                if (F && F->getName().str() == "exit")
+                    ExitBasicBlocks[id] = true;
+            }
+}
+
+// The instructions of the counted basic blocks are folded into the
+// instruction mix at dump time, nothing is analysed here.
+static void static_mix_notification(Function::iterator BB, int f, int bb, const int thread_id) {
+    get_per_thread_info(thread_id);
+
+    if (options & ANALYZE_BBV)
+        WKLDcharForThreads[thread_id].visitBasicBlock(f, bb);
+
+    if (check_if_bb_is_in_included_functions(BB, thread_id))
+        if (!check_if_bb_is_in_excluded_functions(BB, thread_id))
+            WKLDcharForThreads[thread_id].countBasicBlock(f, bb);
+
+    if (ExitBasicBlocks[BasicBlockOffsets[f] + bb])
+        end_app();
+}
+
 // This is a library call that notifies us that to perform the
 // analysis of the bb basic block.
 extern "C" void inst_notification(int f, int bb) {
@@ -485,7 +635,22 @@ extern "C" void inst_notification(int f, int bb) {
         return;
 
     Function::iterator BB = get_basicblock(f, bb, M.get());
-    iter_instructions(BB, BB->begin(), omp_get_thread_num());
+
+    // Static mix: only the basic block executions are counted
+    if (options & ANALYZE_STATIC_MIX) {
+        static_mix_notification(BB, f, bb, omp_get_thread_num());
+        return;
+    }
+
+    const int thread_id = omp_get_thread_num();
+
+    if (options & ANALYZE_BBV)
+        WKLDcharForThreads[thread_id].visitBasicBlock(f, bb);
+
+    if ((options & ANALYZE_FAST_FORWARD) && !fast_forward_block(f, bb, thread_id))
+        return;
+
+    iter_instructions(BB, BB->begin(), thread_id);
 }
 
 static void sigint_handler(int signum) {
@@ -504,6 +669,14 @@ extern "C" void update_branch_entropy_file(char *s) {
     branch_entropy_file = s;
 }
 
+extern "C" void update_interval_file(char *s) {
+    interval_file = s;
+}
+
+extern "C" void update_ff_simpoints_file(char *s) {
+    ff_simpoints_file = s;
+}
+
 extern "C" void test_name(char *s) {
     TestName = s;
 }
@@ -586,6 +759,18 @@ extern "C" void init_libanalysis(char *s, int flags) {
 
     options = flags;
 
+    if ((options & ANALYZE_STATIC_MIX) && (options & ANALYZE_PER_INSTRUCTION)) {
+        cerr << "The static instruction mix cannot be combined with per-instruction analyses; it is disabled\n";
+        options &= ~ANALYZE_STATIC_MIX;
+    }
+
+    if (options & ANALYZE_STATIC_MIX)
+        find_exit_basicblocks();
+
+    // The simpoints of a previous -bbv run select the fast-forward windows
+    if ((options & ANALYZE_FAST_FORWARD) && ff_simpoints_file && *ff_simpoints_file)
+        load_fast_forward_simpoints(ff_simpoints_file, bbv_interval_size ? bbv_interval_size : BBV_DEFAULT_INTERVAL_SIZE);
+
     /*
         In an OpenMP application, init_libanalysis is executed only by the master thread because
         it is put as very first instruction in the main that is not in a parallel section.
@@ -620,7 +805,10 @@ extern "C" void init_libanalysis(char *s, int flags) {
                                                              processor_id, 
                                                              &ls_lock, 
                                                              &ilp_dbg_output_lock, 
-                                                             branch_entropy_file);
+                                                             branch_entropy_file,
+                                                             interval_size,
+                                                             bbv_interval_size,
+                                                             interval_file);
                     MemoryForThreads[thread_id] = map<Instruction *, void *>();
                     SavedStatesForThreads[thread_id] = vector<struct state>();
                 }
@@ -701,6 +889,43 @@ extern "C" void update_window_size(int windowSize) {
     window_size = windowSize;
 }
 
+// This function updates the number of instructions per interval
+extern "C" void update_interval_size(long long size) {
+    interval_size = size;
+}
+
+// This function updates the number of instructions per basic block vector
+extern "C" void update_bbv_interval_size(long long size) {
+    bbv_interval_size = size;
+}
+
+// This function updates the longest history of the online branch entropy
+extern "C" void update_branch_history(int size) {
+    branch_history = size;
+}
+
+// This function updates the number of lines per branch trace file
+extern "C" void update_branch_shard(long long size) {
+    branch_shard_entries = size;
+}
+
+// These functions update the fast-forward settings (in instructions)
+extern "C" void update_ff_skip(long long size) {
+    ff_skip = size;
+}
+
+extern "C" void update_ff_window(long long size) {
+    ff_window = size;
+}
+
+extern "C" void update_ff_period(long long size) {
+    ff_period = size;
+}
+
+extern "C" void update_ff_warmup(long long size) {
+    ff_warmup = size;
+}
+
 static void update_real_memory_issue_cycle(Value *reg, void *real_addr, int type_op, unsigned long long issue_cycle, const int thread_id) {
     get_per_thread_info(thread_id);
     WKLDcharForThreads[thread_id].updateILPIssueCycle(type_op, reg, real_addr, issue_cycle);
@@ -943,6 +1168,14 @@ extern "C" void update_vars(int f, int bb, int i, ...) {
     // pthread_mutex_lock(&threadLock);
 
     va_list argp;
+
+    // The memory addresses are not needed by the static mix, nor by the
+    // basic blocks skipped by the fast-forward mode
+    if (options & ANALYZE_STATIC_MIX)
+        return;
+    if ((options & ANALYZE_FAST_FORWARD) && WKLDcharForThreads[omp_get_thread_num()].skipping())
+        return;
+
     Function::iterator BB = get_basicblock(f, bb, M.get());
     BasicBlock::iterator I = get_instruction(f,bb, i, M.get());
 
@@ -988,6 +1221,9 @@ extern "C" void update_vars(int f, int bb, int i, ...) {
 }
 
 void process_msg(struct message *msg){
+    if (options & ANALYZE_STATIC_MIX)
+        return;
+
     Function::iterator BB = get_basicblock(msg->data.mpi.f_id, msg->data.mpi.bb_id, M.get());
     BasicBlock::iterator I = get_instruction(msg->data.mpi.f_id,
                          msg->data.mpi.bb_id,
@@ -998,6 +1234,10 @@ void process_msg(struct message *msg){
     if (options & ANALYZE_MPI_DATA)
         WKLDcharForThreads[thread_id].process_mpi_data((Instruction*)I, msg);
 
+    // The rest of the basic block is delivered by its next segment
+    if (options & ANALYZE_BATCH_MEMORY)
+        return;
+
     I++;
 
     if (I != BB->end())
@@ -19,6 +19,7 @@
 
 #include "utils.h"
 #include "safe_queue.h"
+#include "TraceFile.h"
 #include <unistd.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -33,8 +34,13 @@ using namespace std;
 char *ip = NULL;
 int portno = -1;
 
+// Prefix of the recorded traces (PISA_RECORD_TRACE): the messages are
+// written to PREFIX.RANK.trace instead of being sent to the server
+char *record_prefix = NULL;
+
 struct thread_specific_data {
     int sockfd;
+    TraceWriter *trace;
 };
 
 vector<struct thread_specific_data> DataForThreads;
@@ -114,10 +120,20 @@ static void get_thread_specific_data() {
         return;
 
     InitializedThreads[thread_id] = true;
-    int sockfd = connect_to_server();
     struct thread_specific_data thread_data;
     memset(&thread_data, 0, sizeof(thread_data));
-    thread_data.sockfd = sockfd;
+
+    if (record_prefix) {
+        char filename[4096];
+        snprintf(filename, sizeof(filename), "%s.%d.trace", record_prefix, procId);
+
+        thread_data.trace = new TraceWriter();
+        if (!thread_data.trace->open(filename))
+            exit(EXIT_FAILURE);
+    } else {
+        thread_data.sockfd = connect_to_server();
+    }
+
     DataForThreads[thread_id] = thread_data;
 }
 
@@ -128,6 +144,12 @@ static void send_msg(struct message *msg) {
     // This would be required for OpenMP applications (bugs araise with MPI due to MPI_Comm_rank after MPI_Finalize). 
     // However bugs should exist also for OpenMP because the thread_id from OpenMP missmatches the thread_id from accept_new_connection.
 
+    if (record_prefix) {
+        DataForThreads[omp_get_thread_num()].trace->write(msg);
+        total_msg_sent++;
+        return;
+    }
+
     int n = safeWrite(DataForThreads[omp_get_thread_num()].sockfd, (char*) msg, sizeof(struct message));
     if (n < 0) {
         fprintf(stderr, "Error: writing to socket\n");
@@ -152,6 +174,13 @@ static void send_msg(struct message *msg) {
 
 }
 
+// Flushes the recorded traces when the application leaves through 'exit'
+static void close_traces(void) {
+    for (unsigned i = 0; i < DataForThreads.size(); i++)
+        if (DataForThreads[i].trace)
+            DataForThreads[i].trace->close();
+}
+
 // This function initialize the libanalysis. Calls different constructors
 // and parse the LLVM IR string.
 extern "C" void init_libanalysis(char *params,int argc, char ** argv) {
@@ -165,9 +194,16 @@ extern "C" void init_libanalysis(char *params,int argc, char ** argv) {
     p = strtok(NULL, ":/");
     max_expected_threads = atoi(p); // FIXME: max_expected_thread is set on the server but this runs on the client. Is it a bug for OpenMP decoupled?
 
+    record_prefix = getenv("PISA_RECORD_TRACE");
+    if (record_prefix && !*record_prefix)
+        record_prefix = NULL;
+
     DataForThreads = vector<struct thread_specific_data>(max_expected_threads);
     InitializedThreads = vector<bool>(max_expected_threads, false);
 
+    if (record_prefix)
+        atexit(close_traces);
+
     get_thread_specific_data();
 }
 
@@ -251,5 +287,8 @@ extern "C" void end_app(void) {
     msg.type = END_APP_NOTIFICATION;
     send_msg(&msg);
 
+    if (record_prefix)
+        DataForThreads[omp_get_thread_num()].trace->close();
+
     MPI_Finalize();
 }
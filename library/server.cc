@@ -33,6 +33,7 @@
 #include "utils.h"
 #include "JSONmanager.h"
 #include "safe_queue.h"
+#include "TraceFile.h"
 #include <string>
 
 #include "llvm/Transforms/Utils/Cloning.h"
@@ -70,6 +71,11 @@ using namespace llvm;
 string moduleFilename;
 string moduleExe;
 char *branch_entropy_file = "";
+char *interval_file = "";
+char *ff_simpoints_file = "";
+// Prefix of the traces recorded with PISA_RECORD_TRACE (-replay)
+char *replay_prefix = NULL;
+bool replay_parallel = false;
 
 char *ip = NULL;
 int portno = -1;
@@ -86,6 +92,8 @@ int inst_size = 0;
 int ilp_type = 0;
 int debug_flag = 0;
 int window_size = 0;
+unsigned long long interval_size = 0;
+unsigned long long bbv_interval_size = 0;
 int accMode = 0;
 
 char *AppName  = "default-app";
@@ -112,6 +120,10 @@ struct connection_data {
     std::unique_ptr<rapidjson::StringBuffer> JSONbuffer;
     int inFunction;
     int thread_id;
+    // Analyses run on this connection: all of them, unless the trace is
+    // replayed in parallel (one group of analyses per replay)
+    unsigned long long options;
+    std::unique_ptr<TraceReader> trace;
 };
 
 // This is a map between a socket-id and its corresponding private data.
@@ -364,6 +376,9 @@ static void iter_instructions(const int thread_id, connection_data* data,
                               Function::iterator BB, BasicBlock::iterator I_init) {
     Instruction *last_processed_inst = NULL;
 
+    if ((data->options & ANALYZE_FAST_FORWARD) && WKLDcharForThreads[data->thread_id].skipping())
+        return;
+
     for (BasicBlock::iterator I = I_init, J = BB->end(); I != J; ++I) {
         Function *_call = NULL;
         if (!strcmp(I->getOpcodeName(), "call")) {
@@ -410,7 +425,7 @@ static void iter_instructions(const int thread_id, connection_data* data,
                 SavedStatesForThreads[thread_id].push_back(current_state);
                 return;
             }
-            if (options & ANALYZE_MPI_MAP) {
+            if (data->options & ANALYZE_MPI_MAP) {
                 if (_call && is_mpi_sync_call(_call))
                     return;
             }
@@ -452,170 +467,218 @@ static void update_memory(Instruction *I, void *addr, const int thread_id) {
     MemoryForThreads[thread_id][I] = addr;
 }
 
-static void *queue_consumer(void *ptr) {
-    struct connection_data *data = (struct connection_data *)ptr;
-    data->inFunction = 0;
-    safe_queue *task_list = data->jobs.get();
+// Fast-forward: positions the thread at the bb basic block and tells whether
+// its instructions are processed. The skipped blocks are not decoded, so
+// their calls and returns are not followed: the call trace is dropped and
+// an analysis window starts with an empty one.
+static bool fast_forward_block(int f, int bb, const int thread_id) {
+    if (WKLDcharForThreads[thread_id].fastForwardBlock(f, bb) != FF_SKIP)
+        return true;
 
-    // TODO!
-    // if (IncludeFunctions.size() == 0)
-    // data->inFunction = 2;
+    SavedStatesForThreads[thread_id].clear();
+    return false;
+}
 
-    // This function is responsible for reconstructing the thread flow.
-    while (!should_stop[data->thread_id]) {
-        struct message msg = task_list->pop_front();
+// This function is responsible for reconstructing the thread flow:
+// it processes one message of a client connection (or of a recorded trace).
+static void process_message(struct connection_data *data, struct message &msg) {
+    switch(msg.type) {
+        case BASICBLOCK_NOTIFICATION: {
+            Function::iterator BB = get_basicblock(msg.data.bb_notif.f_id,
+                               msg.data.bb_notif.bb_id, M.get());
 
-        switch(msg.type) {
-            case BASICBLOCK_NOTIFICATION: {
-                Function::iterator BB = get_basicblock(msg.data.bb_notif.f_id,
-                                   msg.data.bb_notif.bb_id, M.get());
-
-                if (!InitializedThreads[data->thread_id]) {
-                    int thread_id = msg.data.bb_notif.thread_id;
-
-                    InitializedThreads[data->thread_id] = true;
-                    
-                    WKLDcharForThreads[data->thread_id] = WKLDchar(M.get(), 
-                                                                   options, 
-                                                                   data_cache_line_size, 
-                                                                   data_reuse_distance_resolution,
-                                                                   data_reuse_distance_resolution_final_bin, 
-                                                                   inst_cache_line_size,
-                                                                   inst_size, 
-                                                                   ilp_type, 
-                                                                   debug_flag, 
-                                                                   window_size,
-                                                                   thread_id, 
-                                                                   0, 
-                                                                   &ls_lock, 
-                                                                   mpi_map_db.get(), 
-                                                                   &mpi_db_lock, 
-                                                                   accMode, 
-                                                                   &ilp_dbg_output_lock, 
-                                                                   branch_entropy_file);
-                                                                   
-                    MemoryForThreads[data->thread_id] = map<Instruction *, void *>();
-                    SavedStatesForThreads[data->thread_id] = vector<struct state>();
-                }
-
-                // This is used mainly in the case of a per-function analysis to extract a DIMEMAS trace
-                if (options & ANALYZE_MPI_MAP) {
-                    if (data->inFunction == 0) {
-                        if (check_if_bb_is_in_included_functions(BB, data->thread_id))
-                            if (!check_if_bb_is_in_excluded_functions(BB, data->thread_id)) {
-                                data->inFunction = 1;
-                                WKLDcharForThreads[data->thread_id].process_mpi_map(NULL, NULL, 0, data->inFunction);
-                            }
-                        } else {
-                            // To investigate when this happens!
-                            if (!check_if_bb_is_in_included_functions(BB, data->thread_id)) {
-                                data->inFunction = 0;
-                                WKLDcharForThreads[data->thread_id].process_mpi_map(NULL, NULL, 0, data->inFunction);
-                            }
-                        }
-                }
-                iter_instructions(data->thread_id, data, BB, BB->begin());
-                break;
+            if (!InitializedThreads[data->thread_id]) {
+                int thread_id = msg.data.bb_notif.thread_id;
+
+                InitializedThreads[data->thread_id] = true;
+                
+                WKLDcharForThreads[data->thread_id] = WKLDchar(M.get(), 
+                                                               data->options, 
+                                                               data_cache_line_size, 
+                                                               data_reuse_distance_resolution,
+                                                               data_reuse_distance_resolution_final_bin, 
+                                                               inst_cache_line_size,
+                                                               inst_size, 
+                                                               ilp_type, 
+                                                               debug_flag, 
+                                                               window_size,
+                                                               thread_id, 
+                                                               0, 
+                                                               &ls_lock, 
+                                                               mpi_map_db.get(), 
+                                                               &mpi_db_lock, 
+                                                               accMode, 
+                                                               &ilp_dbg_output_lock, 
+                                                               branch_entropy_file,
+                                                               interval_size,
+                                                               bbv_interval_size,
+                                                               interval_file);
+                                                               
+                MemoryForThreads[data->thread_id] = map<Instruction *, void *>();
+                SavedStatesForThreads[data->thread_id] = vector<struct state>();
             }
-            case MEM_ADDR_NOTIFICATION: {
-                Function::iterator BB = get_basicblock(msg.data.mem_notif.f_id, msg.data.mem_notif.bb_id, M.get());
-                BasicBlock::iterator I = get_instruction(msg.data.mem_notif.f_id,
-                                                         msg.data.mem_notif.bb_id,
-                                                         msg.data.mem_notif.i_id, 
-                                                         M.get());
 
-                update_memory(I, msg.data.mem_notif.addr, data->thread_id);
+            if (data->options & ANALYZE_BBV)
+                WKLDcharForThreads[data->thread_id].visitBasicBlock(msg.data.bb_notif.f_id, msg.data.bb_notif.bb_id);
 
-                // if bb is in included functions, but not in exclude
+            // Static mix: only the basic block executions are counted
+            if (data->options & ANALYZE_STATIC_MIX) {
                 if (check_if_bb_is_in_included_functions(BB, data->thread_id))
                     if (!check_if_bb_is_in_excluded_functions(BB, data->thread_id))
-                        process_instr(data, I);
+                        WKLDcharForThreads[data->thread_id].countBasicBlock(msg.data.bb_notif.f_id, msg.data.bb_notif.bb_id);
+                break;
+            }
 
-                I++;
+            // This is used mainly in the case of a per-function analysis to extract a DIMEMAS trace
+            if (data->options & ANALYZE_MPI_MAP) {
+                if (data->inFunction == 0) {
+                    if (check_if_bb_is_in_included_functions(BB, data->thread_id))
+                        if (!check_if_bb_is_in_excluded_functions(BB, data->thread_id)) {
+                            data->inFunction = 1;
+                            WKLDcharForThreads[data->thread_id].process_mpi_map(NULL, NULL, 0, data->inFunction);
+                        }
+                    } else {
+                        // To investigate when this happens!
+                        if (!check_if_bb_is_in_included_functions(BB, data->thread_id)) {
+                            data->inFunction = 0;
+                            WKLDcharForThreads[data->thread_id].process_mpi_map(NULL, NULL, 0, data->inFunction);
+                        }
+                    }
+            }
 
-                if (I != BB->end())
-                    iter_instructions(data->thread_id, data, BB, I);
+            if ((data->options & ANALYZE_FAST_FORWARD) &&
+                !fast_forward_block(msg.data.bb_notif.f_id, msg.data.bb_notif.bb_id, data->thread_id))
                 break;
-            }
 
-            case MPI_UPDATE_PROCESS_ID: {       // This should be the very first call for MPI application and should make sure to update data->threadid
-                data->mpi_processor_id = msg.data.pid;
-                data->thread_id = msg.data.pid; // FIXME: all data structures use only thread_id as identifier. Thus we do not support OpenMP+MPI.
-                                                // FIXME: also OpenMP is not supported:
-                                                // we may need to fix the max_number_of_threads also on the client side
-                                                // we run a queue_consumer for each connected process, threads are running on the same connection (data)
-                                                                                    
-                if (!InitializedThreads[data->thread_id]) {
-                    int thread_id = msg.data.bb_notif.thread_id;
-
-                    InitializedThreads[data->thread_id] = true;
-
-                    WKLDcharForThreads[data->thread_id] = WKLDchar(M.get(), 
-                                                                   options, 
-                                                                   data_cache_line_size, 
-                                                                   data_reuse_distance_resolution,
-                                                                   data_reuse_distance_resolution_final_bin, 
-                                                                   inst_cache_line_size,
-                                                                   inst_size, 
-                                                                   ilp_type, 
-                                                                   debug_flag, 
-                                                                   window_size,
-                                                                   msg.data.pid // FIXME, this had to be thread_id. However this is used as identifier to access data strudtures. 
-                                                                                // At the server side, this data-structures are shared among processes, thus we need an unique process identifier, 
-                                                                                // not the OpenMP thread_id. Thus: a) we do not support OpenMP and 
-                                                                                // b) any analysis on thread-level data sharing is meaningless.
-                                                                   , msg.data.pid, 
-                                                                   &ls_lock, 
-                                                                   mpi_map_db.get(), 
-                                                                   &mpi_db_lock, 
-                                                                   accMode, 
-                                                                   &ilp_dbg_output_lock, 
-                                                                   branch_entropy_file);
-                                                                   
-                    MemoryForThreads[data->thread_id] = map<Instruction *, void *>();
-                    SavedStatesForThreads[data->thread_id] = vector<struct state>();
-                }
-                WKLDcharForThreads[data->thread_id].update_processor_id(msg.data.pid);
+            iter_instructions(data->thread_id, data, BB, BB->begin());
+            break;
+        }
+        case MEM_ADDR_NOTIFICATION: {
+            if (data->options & ANALYZE_STATIC_MIX)
+                break;
+            if ((data->options & ANALYZE_FAST_FORWARD) && WKLDcharForThreads[data->thread_id].skipping())
                 break;
-            }
-            case MPI_CALL_NOTIFICATION: {
-                Function::iterator BB = get_basicblock(msg.data.mpi.f_id, msg.data.mpi.bb_id, M.get());
-                BasicBlock::iterator I = get_instruction(msg.data.mpi.f_id,
-                                                         msg.data.mpi.bb_id,
-                                                         msg.data.mpi.i_id, 
-                                                         M.get());
 
-                if (options & ANALYZE_MPI_MAP) {
-                    WKLDcharForThreads[data->thread_id].process_mpi_map(I, &msg, 1, data->inFunction);
-                }
+            Function::iterator BB = get_basicblock(msg.data.mem_notif.f_id, msg.data.mem_notif.bb_id, M.get());
+            BasicBlock::iterator I = get_instruction(msg.data.mem_notif.f_id,
+                                                     msg.data.mem_notif.bb_id,
+                                                     msg.data.mem_notif.i_id, 
+                                                     M.get());
 
-                if (options & ANALYZE_MPI_DATA) {
-                    WKLDcharForThreads[data->thread_id].process_mpi_data(I, &msg);
-                }
+            update_memory(I, msg.data.mem_notif.addr, data->thread_id);
 
-                I++;
+            // if bb is in included functions, but not in exclude
+            if (check_if_bb_is_in_included_functions(BB, data->thread_id))
+                if (!check_if_bb_is_in_excluded_functions(BB, data->thread_id))
+                    process_instr(data, I);
 
-                if (I != BB->end())
-                    iter_instructions(data->thread_id, data, BB, I);
+            I++;
 
-                break;
+            if (I != BB->end())
+                iter_instructions(data->thread_id, data, BB, I);
+            break;
+        }
+
+        case MPI_UPDATE_PROCESS_ID: {       // This should be the very first call for MPI application and should make sure to update data->threadid
+            data->mpi_processor_id = msg.data.pid;
+            // A replayed trace already has its slot
+            if (!data->trace)
+                data->thread_id = msg.data.pid; // FIXME: all data structures use only thread_id as identifier. Thus we do not support OpenMP+MPI.
+                                            // FIXME: also OpenMP is not supported:
+                                            // we may need to fix the max_number_of_threads also on the client side
+                                            // we run a queue_consumer for each connected process, threads are running on the same connection (data)
+                                                                                
+            if (!InitializedThreads[data->thread_id]) {
+                int thread_id = msg.data.bb_notif.thread_id;
+
+                InitializedThreads[data->thread_id] = true;
+
+                WKLDcharForThreads[data->thread_id] = WKLDchar(M.get(), 
+                                                               data->options, 
+                                                               data_cache_line_size, 
+                                                               data_reuse_distance_resolution,
+                                                               data_reuse_distance_resolution_final_bin, 
+                                                               inst_cache_line_size,
+                                                               inst_size, 
+                                                               ilp_type, 
+                                                               debug_flag, 
+                                                               window_size,
+                                                               msg.data.pid // FIXME, this had to be thread_id. However this is used as identifier to access data strudtures. 
+                                                                            // At the server side, this data-structures are shared among processes, thus we need an unique process identifier, 
+                                                                            // not the OpenMP thread_id. Thus: a) we do not support OpenMP and 
+                                                                            // b) any analysis on thread-level data sharing is meaningless.
+                                                               , msg.data.pid, 
+                                                               &ls_lock, 
+                                                               mpi_map_db.get(), 
+                                                               &mpi_db_lock, 
+                                                               accMode, 
+                                                               &ilp_dbg_output_lock, 
+                                                               branch_entropy_file,
+                                                               interval_size,
+                                                               bbv_interval_size,
+                                                               interval_file);
+                                                               
+                MemoryForThreads[data->thread_id] = map<Instruction *, void *>();
+                SavedStatesForThreads[data->thread_id] = vector<struct state>();
             }
-            case FUNC_ADDRESS: {
-                // This should happen only in the beginning before any BASICBLOCK message is received
-                pthread_mutex_lock(&m_lock);
-                Module::iterator F = get_function(msg.data.mem_notif.f_id, M.get());
-                FunctionsAddresses[msg.data.mem_notif.addr] = F;
-                pthread_mutex_unlock(&m_lock);
-                break;
+            WKLDcharForThreads[data->thread_id].update_processor_id(msg.data.pid);
+            break;
         }
-            case END_APP_NOTIFICATION: {
-                pthread_mutex_lock(&should_stop_lock);
-                should_stop[data->thread_id]=true;
-                pthread_mutex_unlock(&should_stop_lock);
-                break;
+        case MPI_CALL_NOTIFICATION: {
+            Function::iterator BB = get_basicblock(msg.data.mpi.f_id, msg.data.mpi.bb_id, M.get());
+            BasicBlock::iterator I = get_instruction(msg.data.mpi.f_id,
+                                                     msg.data.mpi.bb_id,
+                                                     msg.data.mpi.i_id, 
+                                                     M.get());
+
+            if (data->options & ANALYZE_MPI_MAP) {
+                WKLDcharForThreads[data->thread_id].process_mpi_map(I, &msg, 1, data->inFunction);
+            }
+
+            if (data->options & ANALYZE_MPI_DATA) {
+                WKLDcharForThreads[data->thread_id].process_mpi_data(I, &msg);
             }
+
+            if (data->options & ANALYZE_STATIC_MIX)
+                break;
+
+            I++;
+
+            if (I != BB->end())
+                iter_instructions(data->thread_id, data, BB, I);
+
+            break;
         }
+        case FUNC_ADDRESS: {
+            // This should happen only in the beginning before any BASICBLOCK message is received
+            pthread_mutex_lock(&m_lock);
+            Module::iterator F = get_function(msg.data.mem_notif.f_id, M.get());
+            FunctionsAddresses[msg.data.mem_notif.addr] = F;
+            pthread_mutex_unlock(&m_lock);
+            break;
+    }
+        case END_APP_NOTIFICATION: {
+            pthread_mutex_lock(&should_stop_lock);
+            should_stop[data->thread_id]=true;
+            pthread_mutex_unlock(&should_stop_lock);
+            break;
+        }
+    }
+
+}
 
+static void *queue_consumer(void *ptr) {
+    struct connection_data *data = (struct connection_data *)ptr;
+    data->inFunction = 0;
+    safe_queue *task_list = data->jobs.get();
+
+    // TODO!
+    // if (IncludeFunctions.size() == 0)
+    // data->inFunction = 2;
+
+    while (!should_stop[data->thread_id]) {
+        struct message msg = task_list->pop_front();
+        process_message(data, msg);
     }
 
     while(toDump != data->thread_id)
@@ -635,6 +698,18 @@ static void *queue_consumer(void *ptr) {
     return NULL;
 }
 
+// Replays the recorded trace of one client connection (-replay)
+static void *trace_consumer(void *ptr) {
+    struct connection_data *data = (struct connection_data *)ptr;
+    struct message msg;
+    data->inFunction = 0;
+
+    while (!should_stop[data->thread_id] && data->trace->next(&msg))
+        process_message(data, msg);
+
+    return NULL;
+}
+
 static void accept_new_connections(int sockfd, int epollfd) {
     struct sockaddr in_addr;
     socklen_t in_len;
@@ -661,6 +736,7 @@ static void accept_new_connections(int sockfd, int epollfd) {
     // Add the queue to the list of threads_data
     struct connection_data *data = new connection_data();
     data->sockfd = infd;
+    data->options = options;
     data->jobs.reset(new safe_queue());
 
     auto JSONbuffer = new rapidjson::StringBuffer(0,100000);
@@ -737,24 +813,43 @@ static void print_usage(char *exe_path) {
     fprintf(stderr, "\t\t-ilp-type - specify the ILP type\n");
     fprintf(stderr, "\t\t-ilp-ctrl - with incremental control instruction\n");
     fprintf(stderr, "\t\t-ilp-ignore-ctrl - ignore all control instructions\n");
-    fprintf(stderr, "\t\t-ilp-verbose - verbose output\n");
+    fprintf(stderr, "\t\t-ilp-critical-path - per-function attribution of the critical path\n");
+    fprintf(stderr, "\t\t-ilp-verbose - verbose output (adds the per-cycle issue distribution when -window-size is set)\n");
     fprintf(stderr, "\t\t-window-size - set window size of ILP scheduler\n");
     fprintf(stderr, "\t-analyze-data-temporal-reuse - activates DTR analysis\n");
     fprintf(stderr, "\t-analyze-memory-footprint - activates memory footprint analysis when DTR analysis is enabled\n");
     fprintf(stderr, "\t\t-data-cache-line-size - 0 is equivalent of not using this option\n");
     fprintf(stderr, "\t\t-data-reuse-distance-resolution - 0 is equivalent of not using this option\n");
     fprintf(stderr, "\t\t-data-reuse-distance-resolution-final-bin - 0 is equivalent of not using this option\n");
+    fprintf(stderr, "\t\t-dtr-shards - experimental: compute the reuse distance of each thread with N worker threads\n");
     fprintf(stderr, "\t-analyze-inst-temporal-reuse - activates ITR analysis\n");
     fprintf(stderr, "\t\t-inst-cache-line-size - 0 is equivalent of not using this option\n");
     fprintf(stderr, "\t\t-inst-size - mandatory if the above option is present\n");
     fprintf(stderr, "\t-branch-entropy - activates BE analysis\n");
     fprintf(stderr, "\t-branch-entropy-cond - activates BE analysis only for conditional branches\n");
+    fprintf(stderr, "\t\t-branch-entropy-binary - write a binary trace per thread (FILE.PID.THREAD.btrace)\n");
+    fprintf(stderr, "\t\t-branch-entropy-history - compute BE online for the histories up to N (max 64), in the JSON output instead of the trace\n");
+    fprintf(stderr, "\t\t-branch-entropy-file - write the trace to this file instead of stdout\n");
+    fprintf(stderr, "\t\t-branch-entropy-shard - with -branch-entropy-file: start a new file every N lines (FILE.PID.THREAD.SHARD)\n");
     fprintf(stderr, "\t-mpi-stats - activates MPI calls analysis\n");
     fprintf(stderr, "\t-mpi-map - activates MPI-map analysis (dump)\n");
     fprintf(stderr, "\t-print-load-store - activates LS analysis\n");
     fprintf(stderr, "\t-register-counting - activates RC analysis\n");
     fprintf(stderr, "\t-mpi-data - activate measurement of data exchanged between the processes\n");
     fprintf(stderr, "\t-external-library-call-count - enable counting external library calls\n");
+    fprintf(stderr, "\t-interval-size - dump instruction mix, ILP and DTR statistics every N instructions\n");
+    fprintf(stderr, "\t-bbv - dump SimPoint basic block vectors per interval and pick representative intervals\n");
+    fprintf(stderr, "\t\t-bbv-interval-size - instructions per basic block vector (default 100M)\n");
+    fprintf(stderr, "\t\t-interval-file - prefix of the per-thread interval files\n");
+    fprintf(stderr, "\t-static-mix - instruction mix only, computed from the basic block executions\n");
+    fprintf(stderr, "\t-ff-window - fast-forward: analyse only windows of N instructions\n");
+    fprintf(stderr, "\t\t-ff-skip - instructions executed before the first window\n");
+    fprintf(stderr, "\t\t-ff-period - distance in instructions between the starts of two windows\n");
+    fprintf(stderr, "\t\t-ff-warmup - instructions warming up the DTR state before each window\n");
+    fprintf(stderr, "\t-ff-simpoints - fast-forward: analyse the intervals of a .simpoints file (same -bbv-interval-size, one thread)\n");
+    fprintf(stderr, "\t-replay PREFIX - analyse the traces PREFIX.N.trace recorded with PISA_RECORD_TRACE instead of listening (no -ip/-portno)\n");
+    fprintf(stderr, "\t\t-replay-parallel - replay ILP, DTR and ITR each on its own threads\n");
+    fprintf(stderr, "\t-json-compact - write the JSON output without indentation\n");
     fprintf(stderr, "\t-acc - accumulate instructions between the MPI_Tests\n");
     fprintf(stderr, "\t-max-expected-threads - maximum expected threads spanned by the server\n");
     exit(EXIT_FAILURE);
@@ -804,17 +899,36 @@ static void parse_cmd_args(int argc, char **argv) {
         {"ilp-ctrl", no_argument, 0, 0},
         {"ilp-ignore-ctrl", no_argument, 0, 0},
         {"ilp-verbose", no_argument, 0, 0},
+        {"ilp-critical-path", no_argument, 0, 0},
         {"window-size", required_argument, 0, 'w'},
         {"branch-entropy", no_argument, 0, 0},
         {"branch-entropy-cond", no_argument, 0, 0},
+        {"branch-entropy-binary", no_argument, 0, 0},
         {"mpi-stats", no_argument, 0, 0},
         {"mpi-map", no_argument, 0, 0},
         {"mpi-data", no_argument, 0, 0},
         {"external-library-call-count", no_argument, 0, 0},
+        {"bbv", no_argument, 0, 0},
+        {"static-mix", no_argument, 0, 0},
         {"register-counting", no_argument, 0, 0},
         {"print-load-store", no_argument, 0, 0},
         {"accumulate", required_argument, 0, 'c'},
         {"max-expected-threads", required_argument, 0, 'x'},
+        {"interval-size", required_argument, 0, 'v'},
+        {"bbv-interval-size", required_argument, 0, 'V'},
+        {"interval-file", required_argument, 0, 'y'},
+        {"ff-skip", required_argument, 0, 'l'},
+        {"ff-window", required_argument, 0, 'q'},
+        {"ff-period", required_argument, 0, 'u'},
+        {"ff-warmup", required_argument, 0, 'z'},
+        {"ff-simpoints", required_argument, 0, 'h'},
+        {"replay", required_argument, 0, 'R'},
+        {"replay-parallel", no_argument, 0, 0},
+        {"json-compact", no_argument, 0, 0},
+        {"dtr-shards", required_argument, 0, 'S'},
+        {"branch-entropy-history", required_argument, 0, 'H'},
+        {"branch-entropy-file", required_argument, 0, 'B'},
+        {"branch-entropy-shard", required_argument, 0, 'E'},
         {0, 0, 0, 0}
     };
 
@@ -825,7 +939,7 @@ static void parse_cmd_args(int argc, char **argv) {
 
     while (1) {
         int index = 0;
-        opt = getopt_long_only(argc, argv, "a:b:d:e:f:g:i:j:k:m:n:o:p:r:s:t:x:w:", long_options, &index);
+        opt = getopt_long_only(argc, argv, "a:b:d:e:f:g:h:i:j:k:l:m:n:o:p:q:r:s:t:u:x:w:v:V:y:z:R:S:H:B:E:", long_options, &index);
 
         if (opt == -1)
             break;
@@ -840,6 +954,8 @@ static void parse_cmd_args(int argc, char **argv) {
                 options |= ANALYZE_ILP_IGNORE_CTRL;
             else if (!strcmp(long_options[index].name, "ilp-verbose"))
                 options |= ANALYZE_ILP_VERBOSE;
+            else if (!strcmp(long_options[index].name, "ilp-critical-path"))
+                options |= ANALYZE_ILP_CRITICAL_PATH;
             else if (!strcmp(long_options[index].name, "analyze-data-temporal-reuse"))
                 options |= ANALYZE_DTR;
             else if (!strcmp(long_options[index].name, "analyze-memory-footprint"))
@@ -850,6 +966,8 @@ static void parse_cmd_args(int argc, char **argv) {
                 options |= PRINT_BRANCH;
             else if (!strcmp(long_options[index].name, "branch-entropy-cond"))
                 options |= PRINT_BRANCH_COND;
+            else if (!strcmp(long_options[index].name, "branch-entropy-binary"))
+                options |= BRANCH_TRACE_BINARY;
             else if (!strcmp(long_options[index].name, "register-counting"))
                 options |= ANALYZE_REG_COUNT;
             else if (!strcmp(long_options[index].name, "print-load-store"))
@@ -862,6 +980,14 @@ static void parse_cmd_args(int argc, char **argv) {
                 options |= ANALYZE_MPI_DATA;
             else if (!strcmp(long_options[index].name, "external-library-call-count"))
                 options |= ANALYZE_EXTERNALLIBS_CALLS;
+            else if (!strcmp(long_options[index].name, "bbv"))
+                options |= ANALYZE_BBV;
+            else if (!strcmp(long_options[index].name, "static-mix"))
+                options |= ANALYZE_STATIC_MIX;
+            else if (!strcmp(long_options[index].name, "replay-parallel"))
+                replay_parallel = true;
+            else if (!strcmp(long_options[index].name, "json-compact"))
+                options |= JSON_COMPACT;
             break;
         case 'a':
             ip = strdup(optarg);
@@ -944,14 +1070,79 @@ static void parse_cmd_args(int argc, char **argv) {
         case 'x':
             sscanf(optarg, "%d", &max_expected_threads);
             break;
+        case 'v':
+            sscanf(optarg, "%llu", &interval_size);
+            if (interval_size > 0)
+                options |= ANALYZE_INTERVALS;
+            break;
+        case 'V':
+            sscanf(optarg, "%llu", &bbv_interval_size);
+            break;
+        case 'y':
+            interval_file = strdup(optarg);
+            break;
+        case 'l':
+            sscanf(optarg, "%llu", &ff_skip);
+            break;
+        case 'q':
+            sscanf(optarg, "%llu", &ff_window);
+            if (ff_window > 0)
+                options |= ANALYZE_FAST_FORWARD;
+            break;
+        case 'u':
+            sscanf(optarg, "%llu", &ff_period);
+            break;
+        case 'z':
+            sscanf(optarg, "%llu", &ff_warmup);
+            break;
+        case 'h':
+            ff_simpoints_file = strdup(optarg);
+            options |= ANALYZE_FAST_FORWARD;
+            break;
+        case 'R':
+            replay_prefix = strdup(optarg);
+            break;
+        case 'S':
+            sscanf(optarg, "%u", &dtr_shards);
+            break;
+        case 'H':
+            sscanf(optarg, "%u", &branch_history);
+            break;
+        case 'B':
+            branch_entropy_file = strdup(optarg);
+            break;
+        case 'E':
+            sscanf(optarg, "%llu", &branch_shard_entries);
+            break;
         default:
             print_usage(argv[0]);
         }
     }
 
+    // A replay does not listen for clients
+    if (replay_prefix)
+        mandatory -= (ip == NULL) + (portno == -1);
+
     if (mandatory)
         print_usage(argv[0]);
 
+    if ((options & ANALYZE_STATIC_MIX) && (options & ANALYZE_PER_INSTRUCTION)) {
+        fprintf(stderr, "The static instruction mix cannot be combined with per-instruction analyses; it is disabled\n");
+        options &= ~ANALYZE_STATIC_MIX;
+    }
+
+    if (dtr_shards > 1 && (!data_cache_line_size || (options & ANALYZE_MEM_FOOTPRINT))) {
+        fprintf(stderr, "The sharded reuse distance needs -data-cache-line-size and no memory footprint; it is disabled\n");
+        dtr_shards = 0;
+    }
+
+    if (branch_history && (options & (PRINT_BRANCH | PRINT_BRANCH_COND)))
+        options |= BRANCH_ENTROPY_ONLINE;
+
+    // The simpoints of a previous -bbv run select the fast-forward windows
+    if (*ff_simpoints_file)
+        load_fast_forward_simpoints(ff_simpoints_file, bbv_interval_size ? bbv_interval_size : BBV_DEFAULT_INTERVAL_SIZE);
+
     master_thread = pthread_self();
 
     // Register signal SIGINT
@@ -970,6 +1161,104 @@ static void parse_cmd_args(int argc, char **argv) {
     }
 }
 
+// Analyses replayed on their own threads with -replay-parallel. Everything
+// else (instruction mix included) stays in a single group.
+#define REPLAY_ILP_GROUP (ANALYZE_ILP | ANALYZE_ILP_CTRL | ANALYZE_ILP_VERBOSE | ANALYZE_ILP_IGNORE_CTRL | ANALYZE_ILP_CRITICAL_PATH)
+#define REPLAY_DTR_GROUP (ANALYZE_DTR | ANALYZE_MEM_FOOTPRINT)
+#define REPLAY_ITR_GROUP (ANALYZE_ITR)
+
+// Splits the options into the groups of analyses replayed in parallel.
+// Interval, fast-forward and static mix runs drive several analyses from the
+// same instruction count, so they are replayed as one group.
+static vector<unsigned long long> replay_groups() {
+    vector<unsigned long long> groups;
+
+    if (!replay_parallel || (options & (ANALYZE_INTERVALS | ANALYZE_FAST_FORWARD | ANALYZE_STATIC_MIX))) {
+        groups.push_back(options);
+        return groups;
+    }
+
+    const unsigned long long split[] = {REPLAY_ILP_GROUP, REPLAY_DTR_GROUP, REPLAY_ITR_GROUP};
+    unsigned long long rest = options;
+
+    for (unsigned i = 0; i < sizeof(split) / sizeof(split[0]); i++)
+        if (options & split[i] & (ANALYZE_ILP | ANALYZE_DTR | ANALYZE_ITR)) {
+            groups.push_back((options & split[i]) | (options & PRINT_DEBUG));
+            rest &= ~split[i];
+        }
+
+    // The first group receives the analyses of the others before the dump
+    if (groups.empty() || (rest & ~PRINT_DEBUG))
+        groups.insert(groups.begin(), rest);
+
+    return groups;
+}
+
+// Replays the traces PREFIX.0.trace, PREFIX.1.trace, ... as if the recorded
+// clients were connected, then dumps the analysis. Each trace is mapped once;
+// with -replay-parallel every group of analyses walks it on its own thread
+// (slot group * traces + trace) and the groups are merged at the end.
+static void replay_traces() {
+    vector<unsigned long long> groups = replay_groups();
+    vector<std::unique_ptr<TraceReader>> traces;
+
+    while (1) {
+        char filename[4096];
+        snprintf(filename, sizeof(filename), "%s.%d.trace", replay_prefix, (int)traces.size());
+
+        std::unique_ptr<TraceReader> trace(new TraceReader());
+        if (!trace->open(filename))
+            break;
+
+        traces.push_back(std::move(trace));
+    }
+
+    if (traces.empty()) {
+        fprintf(stderr, "Error: can not open %s.0.trace\n", replay_prefix);
+        exit(EXIT_FAILURE);
+    }
+
+    const int n = traces.size();
+    vector<struct connection_data *> replayed;
+
+    for (unsigned g = 0; g < groups.size(); g++)
+        for (int t = 0; t < n; t++) {
+            struct connection_data *data = new connection_data();
+            data->sockfd = -1;
+            data->thread_id = g * n + t;
+            data->options = groups[g];
+            data->trace.reset(new TraceReader());
+            data->trace->share(*traces[t]);
+            replayed.push_back(data);
+
+            thread_counter++;
+            should_stop.push_back(false);
+        }
+
+    if (max_expected_threads < thread_counter)
+        max_expected_threads = thread_counter;
+
+    InitializedThreads = vector<bool>(max_expected_threads, false);
+    WKLDcharForThreads = vector<WKLDchar>(max_expected_threads);
+    MemoryForThreads = vector<map<Instruction *, void *>>(max_expected_threads);
+    SavedStatesForThreads = vector<vector<struct state>>(max_expected_threads);
+
+    for (unsigned i = 0; i < replayed.size(); i++)
+        pthread_create(&replayed[i]->thread, NULL, trace_consumer, (void *)replayed[i]);
+
+    for (unsigned i = 0; i < replayed.size(); i++)
+        pthread_join(replayed[i]->thread, NULL);
+
+    for (unsigned g = 1; g < groups.size(); g++)
+        for (int t = 0; t < n; t++)
+            if (InitializedThreads[g * n + t]) {
+                WKLDcharForThreads[t].mergeAnalyses(WKLDcharForThreads[g * n + t]);
+                InitializedThreads[g * n + t] = false;
+            }
+
+    dump_analysis();
+}
+
 bool checkStoppingCondition() {
     if(thread_counter <= 0)
         return false;
@@ -993,6 +1282,12 @@ int main(int argc, char **argv) {
     //MPI_Init(NULL, NULL);
 
     parse_cmd_args(argc, argv);
+
+    if (replay_prefix) {
+        replay_traces();
+        return 0;
+    }
+
     sockfd = boot_server();
 
     int epollfd = epoll_create(MAXEVENTS);
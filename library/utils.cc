@@ -17,6 +17,15 @@ using namespace llvm;
 
 bool weDecoupled=0;
 int max_expected_threads = 1;
+
+unsigned long long ff_skip = 0;
+unsigned long long ff_window = 0;
+unsigned long long ff_period = 0;
+unsigned long long ff_warmup = 0;
+vector<unsigned long long> ff_windows;
+unsigned dtr_shards = 0;
+unsigned branch_history = 0;
+unsigned long long branch_shard_entries = 0;
 vector<bool> InitializedThreads;
 
 // Maps between LLVM load/store instructions and real memory addresses
@@ -26,6 +35,11 @@ vector<vector<struct state>> SavedStatesForThreads;
 map<void *, Function *> FunctionsAddresses;
 static pthread_mutex_t mem2_lock = PTHREAD_MUTEX_INITIALIZER;
 
+vector<unsigned> BasicBlockOffsets;
+vector<unsigned> BasicBlockSizes;
+vector<BasicBlock *> BasicBlockPointers;
+static pthread_mutex_t bb_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // Round double number with 4 decimals
 double double4(double x) {
     double result = x;
@@ -35,6 +49,71 @@ double double4(double x) {
     return result;
 }
 
+// Numbers the basic blocks in the same order as the (f, bb) ids inserted
+// by the pass. Only the first call builds the index.
+void build_basicblock_index(Module *M) {
+    pthread_mutex_lock(&bb_index_lock);
+
+    if (BasicBlockOffsets.empty() && M) {
+        for (Module::iterator F = M->begin(), N = M->end(); F != N; ++F) {
+            BasicBlockOffsets.push_back(BasicBlockSizes.size());
+            for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB) {
+                BasicBlockPointers.push_back(&*BB);
+                unsigned size = 0;
+                for (BasicBlock::iterator I = BB->begin(), J = BB->end(); I != J; ++I)
+                    if (!isa<PHINode>(*I))
+                        size++;
+                BasicBlockSizes.push_back(size);
+            }
+        }
+        BasicBlockOffsets.push_back(BasicBlockSizes.size());
+    }
+
+    pthread_mutex_unlock(&bb_index_lock);
+}
+
+// Reads the representative intervals ("<interval> <cluster>" lines) of a
+// SimPoint .simpoints file. The interval k of a -bbv run starts exactly at
+// the non-phi instruction k * interval_size of its thread, which is the
+// position counted by the fast-forward mode. The same windows are applied to
+// every thread, so they match the .simpoints of a single-threaded run (or of
+// the thread the file was written by) only.
+void load_fast_forward_simpoints(const char *filename, unsigned long long interval_size) {
+    unsigned long long interval;
+    int cluster;
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "Could not open the simpoints file %s\n", filename);
+        return;
+    }
+
+    ff_windows.clear();
+    while (fscanf(fp, "%llu %d", &interval, &cluster) == 2)
+        ff_windows.push_back(interval * interval_size);
+    fclose(fp);
+
+    std::sort(ff_windows.begin(), ff_windows.end());
+    ff_window = interval_size;
+}
+
+// Returns the [start, end) instruction range of the k-th analysis window
+bool get_fast_forward_window(unsigned long long k, unsigned long long &start, unsigned long long &end) {
+    if (!ff_windows.empty()) {
+        if (k >= ff_windows.size())
+            return false;
+        start = ff_windows[k];
+    } else {
+        // A single window if no period is given
+        if (k > 0 && !ff_period)
+            return false;
+        start = ff_skip + k * max(ff_period, ff_window);
+    }
+
+    end = start + ff_window;
+    return true;
+}
+
 // This function returns the Function * of a given function id (f)
 Module::iterator get_function(int f, Module *M) {
     if (!M)
@@ -38,6 +38,23 @@
 #define ANALYZE_MPI_DATA        32768
 #define ANALYZE_MEM_FOOTPRINT   65536
 #define ANALYZE_EXTERNALLIBS_CALLS  131072
+#define ANALYZE_ILP_CRITICAL_PATH   262144
+#define ANALYZE_INTERVALS           524288
+#define ANALYZE_BBV                 1048576
+#define ANALYZE_FAST_FORWARD        2097152
+#define ANALYZE_STATIC_MIX          4194304
+#define ANALYZE_BATCH_MEMORY        8388608
+#define JSON_COMPACT                16777216
+#define JSON_PER_RANK               33554432
+#define BRANCH_ENTROPY_ONLINE       67108864
+#define BRANCH_TRACE_BINARY         134217728
+
+// Analyses that need to visit every executed instruction; none of them
+// can run with ANALYZE_STATIC_MIX
+#define ANALYZE_PER_INSTRUCTION (ANALYZE_ILP | ANALYZE_ITR | ANALYZE_DTR | ANALYZE_REG_COUNT | \
+                                 PRINT_LOAD_STORE | ANALYZE_MPI_CALLS | PRINT_BRANCH | PRINT_BRANCH_COND | \
+                                 ANALYZE_OPENMP_CALLS | ANALYZE_MPI_MAP | ANALYZE_MPI_DATA | \
+                                 ANALYZE_EXTERNALLIBS_CALLS | ANALYZE_INTERVALS | ANALYZE_FAST_FORWARD)
 
 #define READ_OPERATION  0
 #define WRITE_OPERATION 1
@@ -205,6 +222,42 @@ typedef struct {
 // Instantiated in utils.cc
 extern int max_expected_threads;  
 
+// Fast-forward mode: only the instructions inside the analysis windows are
+// analysed. The DTR state is warmed up during the ff_warmup instructions
+// preceding each window. Instantiated in utils.cc
+#define FF_SKIP     0
+#define FF_WARMUP   1
+#define FF_ANALYZE  2
+
+extern unsigned long long ff_skip;
+extern unsigned long long ff_window;
+extern unsigned long long ff_period;
+extern unsigned long long ff_warmup;
+// Window starts read from a SimPoint .simpoints file (overrides ff_skip and ff_period)
+extern vector<unsigned long long> ff_windows;
+
+void load_fast_forward_simpoints(const char *filename, unsigned long long interval_size);
+bool get_fast_forward_window(unsigned long long k, unsigned long long &start, unsigned long long &end);
+
+// Worker threads of the experimental parallel reuse distance of each DTR
+// analysis (0 or 1: sequential). Instantiated in utils.cc
+extern unsigned dtr_shards;
+
+// Longest history of the online branch entropy (BRANCH_ENTROPY_ONLINE).
+// Instantiated in utils.cc
+extern unsigned branch_history;
+
+// Lines per file of the branch trace (0: a single file). Instantiated in
+// utils.cc
+extern unsigned long long branch_shard_entries;
+
+// Dense numbering of the basic blocks of the module, built once and
+// shared by all threads: id = BasicBlockOffsets[f] + bb
+extern vector<unsigned> BasicBlockOffsets;
+extern vector<unsigned> BasicBlockSizes; // number of non-phi instructions
+extern vector<BasicBlock *> BasicBlockPointers;
+void build_basicblock_index(Module *M);
+
 Module::iterator get_function(int f, Module *M);
 Function::iterator get_basicblock(int f, int bb, Module *M);
 BasicBlock::iterator get_instruction(int f, int bb, int i, Module *M);
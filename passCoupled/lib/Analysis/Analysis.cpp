@@ -29,6 +29,7 @@
 
 #include <iostream>
 #include <map>
+#include <algorithm>
 #include <string>
 
 // Those defines should be the same as in libanalysis.cc
@@ -77,6 +78,21 @@
 #define ANALYZE_MPI_DATA        32768
 #define ANALYZE_MEM_FOOTPRINT   65536
 #define ANALYZE_EXTERNALLIBS_CALLS  131072
+#define ANALYZE_ILP_CRITICAL_PATH   262144
+#define ANALYZE_INTERVALS           524288
+#define ANALYZE_BBV                 1048576
+#define ANALYZE_FAST_FORWARD        2097152
+#define ANALYZE_STATIC_MIX          4194304
+#define ANALYZE_BATCH_MEMORY        8388608
+#define JSON_COMPACT                16777216
+#define JSON_PER_RANK               33554432
+#define BRANCH_ENTROPY_ONLINE       67108864
+#define BRANCH_TRACE_BINARY         134217728
+
+#define ANALYZE_PER_INSTRUCTION (ANALYZE_ILP | ANALYZE_ITR | ANALYZE_DTR | ANALYZE_REG_COUNT | \
+                                 PRINT_LOAD_STORE | ANALYZE_MPI_CALLS | PRINT_BRANCH | PRINT_BRANCH_COND | \
+                                 ANALYZE_OPENMP_CALLS | ANALYZE_MPI_MAP | ANALYZE_MPI_DATA | \
+                                 ANALYZE_EXTERNALLIBS_CALLS | ANALYZE_INTERVALS | ANALYZE_FAST_FORWARD)
 
 using namespace llvm;
 
@@ -87,8 +103,9 @@ std::map<std::string, Value *> var_names;
 // argument, its type and a short description.
 cl::opt<bool> ILPAnalyze("analyze-ilp", cl::desc("Enable ILP analysis"));
 cl::opt<bool> ILPCtrl("ilp-ctrl", cl::desc("ILP with incremental control instructions"));
-cl::opt<bool> ILPVerbose("ilp-verbose", cl::desc("ILP verbose output"));
+cl::opt<bool> ILPVerbose("ilp-verbose", cl::desc("ILP verbose output (adds the per-cycle issue distribution when -window-size is set)"));
 cl::opt<bool> ILPIgnoreCtrl("ilp-ignore-ctrl", cl::desc("ILP without any control instruction"));
+cl::opt<bool> ILPCriticalPath("ilp-critical-path", cl::desc("ILP with per-function attribution of the critical path"));
 
 cl::opt<bool> DTRAnalyze("analyze-data-temporal-reuse", cl::desc("Enable data temporal reuse analysis"));
 cl::opt<bool> DTRMemFootprint("analyze-memory-footprint", cl::desc("Enable memory footprint analysis - to be run in parallel with the DTR analysis. Default: disabled."),cl::init(0));
@@ -123,6 +140,22 @@ cl::opt<int> WindowSize("window-size", cl::desc("Set window size for ILP schedul
 cl::opt<bool> BranchEntropy("branch-entropy", cl::desc("Enable dump towards computing branch entropy"), cl::init(false));
 cl::opt<std::string> BranchEntropyFile("branch-entropy-file", cl::desc("Dump branch entropy trace to the specified file. Default is stdout."), cl::init(""));
 cl::opt<bool> BranchEntropyCond("branch-entropy-cond", cl::desc("Enable dump towards computing branch entropy, only for conditional branches"), cl::init(false));
+cl::opt<bool> BranchEntropyBinary("branch-entropy-binary", cl::desc("With -branch-entropy(-cond): write a binary trace per thread (FILE.PID.THREAD.btrace) instead of the text trace"), cl::init(false));
+cl::opt<int> BranchEntropyHistory("branch-entropy-history", cl::desc("With -branch-entropy(-cond): compute the branch entropy online for the histories up to N (max 64) and write it to the JSON output instead of the trace"), cl::init(0));
+cl::opt<unsigned long long> BranchEntropyShard("branch-entropy-shard", cl::desc("With -branch-entropy-file: start a new trace file every N lines (FILE.PID.THREAD.SHARD)"), cl::init(0));
+cl::opt<unsigned long long> IntervalSize("interval-size", cl::desc("Dump instruction mix, ILP and DTR statistics every N instructions. 0 disables the interval output"), cl::init(0));
+cl::opt<std::string> IntervalFile("interval-file", cl::desc("Prefix of the per-thread interval files. Default is pisa-intervals."), cl::init(""));
+cl::opt<unsigned long long> FFSkip("ff-skip", cl::desc("Fast-forward: number of instructions executed before the first analysis window"), cl::init(0));
+cl::opt<unsigned long long> FFWindow("ff-window", cl::desc("Fast-forward: number of instructions fully analysed per window. 0 disables the fast-forward mode"), cl::init(0));
+cl::opt<unsigned long long> FFPeriod("ff-period", cl::desc("Fast-forward: distance in instructions between the starts of two windows. 0 means a single window"), cl::init(0));
+cl::opt<unsigned long long> FFWarmup("ff-warmup", cl::desc("Fast-forward: number of instructions warming up the DTR state before each window"), cl::init(0));
+cl::opt<std::string> FFSimpoints("ff-simpoints", cl::desc("Fast-forward: analyse the intervals listed in a .simpoints file produced by -bbv (same -bbv-interval-size). The windows apply to every thread"), cl::init(""));
+cl::opt<bool> StaticMix("static-mix", cl::desc("Instruction mix only: count the basic block executions and expand them at the end. Loads and stores are not instrumented"), cl::init(false));
+cl::opt<bool> BatchMemory("batch-memory", cl::desc("Deliver the memory addresses of a basic block in one call (before each call and before the terminator) instead of one call per load/store"), cl::init(false));
+cl::opt<bool> JSONCompact("json-compact", cl::desc("Write the JSON output without indentation"), cl::init(false));
+cl::opt<bool> JSONPerRank("json-per-rank", cl::desc("MPI: each rank writes its own output file (FILE.rank.N, merged with json_merge)"), cl::init(false));
+cl::opt<bool> BBV("bbv", cl::desc("Dump SimPoint basic block vectors per interval (-bbv-interval-size) and pick representative intervals"), cl::init(false));
+cl::opt<unsigned long long> BBVIntervalSize("bbv-interval-size", cl::desc("With -bbv: number of instructions per basic block vector. Default is 100M"), cl::init(0));
 cl::opt<int> MaxExpectedNrOfThreads("max-expected-threads", cl::desc("Maximum expected number of threads"), cl::init(1));
 cl::opt<std::string> MPISync("mpi-sync", cl::desc("Enable MPI sync for computing issue cycles"), cl::init(""));
 cl::opt<std::string> MPIMap("mpi-map", cl::desc("Enable MPI mapping dump"), cl::init(""));
@@ -159,6 +192,24 @@ namespace {
                                                    (Type *)NULL);
             Instruction *new_inst = CallInst::Create(cast<Function>(hook), args, "");
             
+#if LLVM_VERSION_MINOR > 7
+            auto InsertPt = I->getIterator();
+            BB->getInstList().insertAfter(InsertPt, new_inst);
+#else
+            BB->getInstList().insertAfter(I, new_inst);
+#endif
+        }
+
+        static void sendSize64(Module &M, Function::iterator BB, Instruction *I, std::string name, unsigned long long value) {
+            std::vector<Value *> args;
+            args.push_back(ConstantInt::get(Type::getInt64Ty(M.getContext()), value));
+
+            Constant *hook = M.getOrInsertFunction(name, 
+                                                   Type::getVoidTy(M.getContext()),
+                                                   Type::getInt64Ty(M.getContext()), 
+                                                   (Type *)NULL);
+            Instruction *new_inst = CallInst::Create(cast<Function>(hook), args, "");
+            
 #if LLVM_VERSION_MINOR > 7
             auto InsertPt = I->getIterator();
             BB->getInstList().insertAfter(InsertPt, new_inst);
@@ -356,6 +407,67 @@ namespace {
                 BB->getInstList().insertAfter(befp_gepi, ni3);    
 #endif
 
+                std::vector<Value *> v4;
+                Value *ivfp = builder.CreateGlobalStringPtr(IntervalFile.c_str());
+                GetElementPtrInst *ivfp_gepi = GetElementPtrInst::CreateInBounds(ivfp, v4, "", (Instruction*)I);
+
+                std::vector<Value *> a4;
+                a4.push_back(ivfp_gepi);
+                Constant *h4 = M.getOrInsertFunction("update_interval_file",
+                                                     Type::getVoidTy(M.getContext()),
+                                                     PointerType::getUnqual(Type::getInt8Ty(M.getContext())),
+                                                     (Type *) NULL);
+
+                Instruction *ni4 = CallInst::Create(cast<Function>(h4), a4, "");
+                        
+#if LLVM_VERSION_MINOR > 7
+                InsertPt = ivfp_gepi->getIterator();
+                BB->getInstList().insertAfter(InsertPt, ni4);
+#else
+                BB->getInstList().insertAfter(ivfp_gepi, ni4);    
+#endif
+
+                std::vector<Value *> v5;
+                Value *ffsp = builder.CreateGlobalStringPtr(FFSimpoints.c_str());
+                GetElementPtrInst *ffsp_gepi = GetElementPtrInst::CreateInBounds(ffsp, v5, "", (Instruction*)I);
+
+                std::vector<Value *> a5;
+                a5.push_back(ffsp_gepi);
+                Constant *h5 = M.getOrInsertFunction("update_ff_simpoints_file",
+                                                     Type::getVoidTy(M.getContext()),
+                                                     PointerType::getUnqual(Type::getInt8Ty(M.getContext())),
+                                                     (Type *) NULL);
+
+                Instruction *ni5 = CallInst::Create(cast<Function>(h5), a5, "");
+                        
+#if LLVM_VERSION_MINOR > 7
+                InsertPt = ffsp_gepi->getIterator();
+                BB->getInstList().insertAfter(InsertPt, ni5);
+#else
+                BB->getInstList().insertAfter(ffsp_gepi, ni5);    
+#endif
+
+            if (IntervalSize > 0)
+                sendSize64(M, BB, new_inst, "update_interval_size", IntervalSize);
+
+            if (BBVIntervalSize > 0)
+                sendSize64(M, BB, new_inst, "update_bbv_interval_size", BBVIntervalSize);
+
+            if (BranchEntropyHistory > 0)
+                sendSize(M, BB, new_inst, "update_branch_history", BranchEntropyHistory);
+
+            if (BranchEntropyShard)
+                sendSize64(M, BB, new_inst, "update_branch_shard", BranchEntropyShard);
+
+            if (FFSkip)
+                sendSize64(M, BB, new_inst, "update_ff_skip", FFSkip);
+            if (FFWindow)
+                sendSize64(M, BB, new_inst, "update_ff_window", FFWindow);
+            if (FFPeriod)
+                sendSize64(M, BB, new_inst, "update_ff_period", FFPeriod);
+            if (FFWarmup)
+                sendSize64(M, BB, new_inst, "update_ff_warmup", FFWarmup);
+
             if (DTRCacheLineSize != 0)
                 sendSize(M, BB, new_inst, "update_data_cache_line_size", DTRCacheLineSize);
             
@@ -475,6 +587,58 @@ namespace {
         }
 
 
+        // A segment of a basic block ends with a call (except LLVM's intrinsics)
+        // or with the terminator. Used by -batch-memory.
+        static bool isSegmentEnd(BasicBlock::iterator I) {
+            if (I->isTerminator())
+                return true;
+
+            if (!strcmp(I->getOpcodeName(), "call")) {
+                Function *_call = get_calledFunction(cast<CallInst>(I));
+                return !_call || strncmp(_call->getName().str().c_str(), "llvm.", 5);
+            }
+
+            return false;
+        }
+
+        // Stores the addresses of the loads/stores of the current segment into
+        // the 'addresses' array and inserts, before I, the 'mem_batch_notification'
+        // call that hands them to the library.
+        static void insertMemoryBatch(Module &M, Function::iterator BB, BasicBlock::iterator I,
+                int f, int bb, int first, AllocaInst *addresses, std::vector<Value *> &segment) {
+            Type *i8ptr = PointerType::getUnqual(Type::getInt8Ty(M.getContext()));
+
+            for (unsigned k = 0; k < segment.size(); k++) {
+                Instruction *addr = CastInst::CreatePointerCast(segment[k], i8ptr, "", (Instruction*)I);
+
+                std::vector<Value *> idx;
+                idx.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), k));
+                GetElementPtrInst *slot = GetElementPtrInst::CreateInBounds(addresses, idx, "", (Instruction*)I);
+
+                new StoreInst(addr, slot, (Instruction*)I);
+            }
+
+            std::vector<Value *> args;
+            args.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), f));
+            args.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), bb));
+            args.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), first));
+            args.push_back(addresses);
+            args.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), segment.size()));
+
+            Constant *hook = M.getOrInsertFunction("mem_batch_notification",
+                                                   Type::getVoidTy(M.getContext()),
+                                                   Type::getInt32Ty(M.getContext()), // Function ID
+                                                   Type::getInt32Ty(M.getContext()), // Basic Block ID
+                                                   Type::getInt32Ty(M.getContext()), // First instruction of the segment
+                                                   PointerType::getUnqual(i8ptr),    // Addresses
+                                                   Type::getInt32Ty(M.getContext()), // Number of addresses
+                                                   (Type *) NULL);
+            Instruction *new_inst = CallInst::Create(cast<Function>(hook), args, "");
+            BB->getInstList().insert(I, new_inst);
+
+            segment.clear();
+        }
+
         static void insertEndApplication(Module &M, Function::iterator BB, BasicBlock::iterator I) {
             std::vector<Value *> args;
             Constant *hook = M.getOrInsertFunction("end_app", Type::getVoidTy(M.getContext()), (Type *)NULL);
@@ -970,6 +1134,8 @@ namespace {
                     flags |= ANALYZE_ILP_VERBOSE;
                 if (ILPIgnoreCtrl)
                     flags |= ANALYZE_ILP_IGNORE_CTRL;
+                if (ILPCriticalPath)
+                    flags |= ANALYZE_ILP_CRITICAL_PATH;
                 if (ILPType >= 0)
                     flags |= ANALYZE_ILP_TYPE;
             }
@@ -989,6 +1155,10 @@ namespace {
                 flags |= PRINT_BRANCH;
             if (BranchEntropyCond)
                 flags |= PRINT_BRANCH_COND;
+            if ((BranchEntropy || BranchEntropyCond) && BranchEntropyHistory > 0)
+                flags |= BRANCH_ENTROPY_ONLINE;
+            if (BranchEntropyBinary)
+                flags |= BRANCH_TRACE_BINARY;
             if (MPICalls)
                 flags |= ANALYZE_MPI_CALLS;
             if (MPIData)
@@ -997,6 +1167,24 @@ namespace {
                 flags |= ANALYZE_OPENMP_CALLS;
             if (ExternalLibraryCalls)
                 flags |= ANALYZE_EXTERNALLIBS_CALLS;
+            if (IntervalSize > 0)
+                flags |= ANALYZE_INTERVALS;
+            if (BBV)
+                flags |= ANALYZE_BBV;
+            if (FFWindow > 0 || !FFSimpoints.empty())
+                flags |= ANALYZE_FAST_FORWARD;
+            if (StaticMix) {
+                if (flags & ANALYZE_PER_INSTRUCTION)
+                    errs() << "-static-mix cannot be combined with per-instruction analyses; it is ignored\n";
+                else
+                    flags |= ANALYZE_STATIC_MIX;
+            }
+            if (BatchMemory && !(flags & ANALYZE_STATIC_MIX))
+                flags |= ANALYZE_BATCH_MEMORY;
+            if (JSONCompact)
+                flags |= JSON_COMPACT;
+            if (JSONPerRank)
+                flags |= JSON_PER_RANK;
                 
 
             IRBuilder<> builder(M.getContext());
@@ -1022,6 +1210,14 @@ namespace {
                 if (F->isDeclaration())
                     continue;
 
+                // Array receiving the memory addresses of a segment (-batch-memory).
+                // It is placed in the entry block once its size is known.
+                AllocaInst *batch_addresses = NULL;
+                unsigned batch_size = 0;
+                if (flags & ANALYZE_BATCH_MEMORY)
+                    batch_addresses = new AllocaInst(PointerType::getUnqual(Type::getInt8Ty(M.getContext())),
+                                                     ConstantInt::get(Type::getInt32Ty(M.getContext()), 1), "");
+
                 int bb = 0;
                 // For each basic block inside the current function (F)
                 for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB, ++bb) {
@@ -1032,6 +1228,10 @@ namespace {
                     // already inserted inside the current basic block.
                     int bb_notif = 0;
 
+                    // First instruction and memory addresses of the current segment (-batch-memory)
+                    int segment_first = 0;
+                    std::vector<Value *> segment;
+
                     // For each instruction inside the current basic block (BB)
                     for (BasicBlock::iterator I = BB->begin(), J = BB->end(); I != J; ++I) {
                         // We are looking for the first basic block inside the main
@@ -1075,14 +1275,32 @@ namespace {
                         // If the current basic block does not have the 'inst_notification'
                         // call inserted, we insert it and set 'bb_notif' variable
                         if (!bb_notif) {
-                            insertInstNotification(M, BB, I, f, bb, i, "inst_notification");
+                            if (!(flags & ANALYZE_BATCH_MEMORY))
+                                insertInstNotification(M, BB, I, f, bb, i, "inst_notification");
                             bb_notif = 1;
                         }
 
+                        // With -batch-memory the addresses are collected and delivered
+                        // at the end of the segment
+                        if (flags & ANALYZE_BATCH_MEMORY) {
+                            if (!strcmp(I->getOpcodeName(), "load"))
+                                segment.push_back(cast<LoadInst>(I)->getPointerOperand());
+                            else if (!strcmp(I->getOpcodeName(), "store"))
+                                segment.push_back(cast<StoreInst>(I)->getPointerOperand());
+
+                            if (isSegmentEnd(I)) {
+                                batch_size = std::max(batch_size, (unsigned)segment.size());
+                                insertMemoryBatch(M, BB, I, f, bb, segment_first, batch_addresses, segment);
+                                segment_first = i + 1;
+                            }
+                        }
+
                         // If the current basic block is a 'load' or a 'store' instruction
                         // we must insert 'update_vars' call.
-                        if (!strcmp(I->getOpcodeName(), "load") ||
-                                !strcmp(I->getOpcodeName(), "store")) {
+                        // The static mix does not need the memory addresses.
+                        if (!(flags & (ANALYZE_STATIC_MIX | ANALYZE_BATCH_MEMORY)) &&
+                                (!strcmp(I->getOpcodeName(), "load") ||
+                                 !strcmp(I->getOpcodeName(), "store"))) {
                             // Insert after the current Instruction
                             insertLSValues(M, BB, I, f, bb, i);
 
@@ -1114,6 +1332,15 @@ namespace {
                             insertEndApplication(M, BB, I);
                     }
                 }
+
+                if (batch_addresses) {
+                    if (batch_addresses->use_empty()) {
+                        delete batch_addresses;
+                    } else {
+                        batch_addresses->setOperand(0, ConstantInt::get(Type::getInt32Ty(M.getContext()), batch_size ? batch_size : 1));
+                        F->getEntryBlock().getInstList().push_front(batch_addresses);
+                    }
+                }
             }
 
         return false;